@@ -3,16 +3,37 @@
 #include <string>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
 #include <list>
 #include <pthread.h>
 #include <iostream>
 #include "sql_connection_pool.h"
+#include "../metrics/metrics.h"
 
 using namespace std;
 
+static const int SHRINK_IDLE = 60;    // 持续该秒数没有等待才开始缩容
+static const int SLOW_WAIT_US = 1000; // 平均等待超过1ms认为连接不足
+static const unsigned int CONNECT_TIMEOUT = 3;  // 建连超时(s)
+static const unsigned int IO_TIMEOUT = 5;       // 读写超时(s)，避免数据库卡顿时工作线程无限阻塞
+
+// mysql客户端错误码，表示连接已断开
+static const unsigned int CR_SERVER_GONE = 2006;
+static const unsigned int CR_SERVER_LOST = 2013;
+
 connection_pool::connection_pool() {
+    m_MaxConn = 0;
+    m_MinConn = 0;
     m_CurConn = 0;
     m_FreeConn = 0;
+    m_timeout = 0;
+    m_waits = 0;
+    m_timeouts = 0;
+    m_wait_us = 0;
+    m_last_busy = 0;
+    m_stop.store(false);
+    m_running = false;
 }
 
 connection_pool *connection_pool::GetInstance() {
@@ -21,7 +42,8 @@ connection_pool *connection_pool::GetInstance() {
 }
 
 // 构造初始化
-void connection_pool::init(string url, string User, string PassWord, string DBName, int Port, int MaxConn, int close_log) {
+void connection_pool::init(string url, string User, string PassWord, string DBName, int Port, int MaxConn,
+                           int close_log, int MinConn, int timeout_ms) {
     // 初始化数据库信息
     m_url = url;
     m_Port = Port;
@@ -29,65 +51,118 @@ void connection_pool::init(string url, string User, string PassWord, string DBNa
     m_PassWord = PassWord;
     m_DatabaseName = DBName;
     m_close_log = close_log;
+    m_timeout = timeout_ms;
 
-    // 创建MaxConn条数据库连接
-    for (int i = 0; i < MaxConn; i++) {
-        MYSQL *con = NULL;
-        con = mysql_init(con);
+    m_MaxConn = MaxConn;
+    // 未指定或不合法时为固定大小的连接池
+    m_MinConn = (MinConn <= 0 || MinConn > MaxConn) ? MaxConn : MinConn;
+    if (m_MaxConn <= 0) {
+        return;
+    }
 
+    // 先创建MinConn条数据库连接，失败不再退出进程，由后台线程继续重试
+    for (int i = 0; i < m_MinConn; i++) {
+        MYSQL *con = connect();
         if (con == NULL) {
-            LOG_ERROR("MySQL Error");
-            exit(1);
+            LOG_ERROR("MySQL Error: only %d of %d connections established, retry in background", i, m_MinConn);
+            break;
         }
+        put_idle(con);
+    }
 
-        //                   MYSQL对象    IP          user           passwd          database
-        con = mysql_real_connect(con, url.c_str(), User.c_str(), PassWord.c_str(), DBName.c_str(), Port, NULL, 0);
-
-        // 若连接数据库失败
-        if (con == NULL) {
-            LOG_ERROR("MySQL Error");
-            exit(1);
-        }
+    // 启动维护线程
+    if (pthread_create(&m_maintainer, NULL, maintain_thread, this) == 0) {
+        m_running = true;
+    }
+}
 
-        // 连接成功则更新连接池和空闲连接数量
-        connList.push_back(con);
-        ++m_FreeConn;
+MYSQL *connection_pool::connect() {
+    MYSQL *con = mysql_init(NULL);
+    if (con == NULL) {
+        LOG_ERROR("MySQL Error: mysql_init failed");
+        return NULL;
     }
 
-    // 将信号量初始化为最大连接次数
-    reserve = sem(m_FreeConn);
+    mysql_options(con, MYSQL_OPT_CONNECT_TIMEOUT, &CONNECT_TIMEOUT);
+    mysql_options(con, MYSQL_OPT_READ_TIMEOUT, &IO_TIMEOUT);
+    mysql_options(con, MYSQL_OPT_WRITE_TIMEOUT, &IO_TIMEOUT);
 
-    m_MaxConn = m_FreeConn;
+    //                   MYSQL对象    IP          user           passwd          database
+    if (mysql_real_connect(con, m_url.c_str(), m_User.c_str(), m_PassWord.c_str(), m_DatabaseName.c_str(), m_Port,
+                           NULL, 0) == NULL) {
+        LOG_ERROR("MySQL Error: %s", mysql_error(con));
+        mysql_close(con);
+        return NULL;
+    }
+    return con;
 }
 
+void connection_pool::put_idle(MYSQL *con) {
+    idle_conn ic = {con, time(NULL)};
+    lock.lock();
+    connList.push_back(ic);
+    ++m_FreeConn;
+    lock.unlock();
+    reserve.post();
+}
 
 // 当有请求时，从数据库连接池中返回一个可用连接，更新使用和空闲连接数
+// 超过m_timeout仍没有空闲连接则快速失败返回NULL，不再无限阻塞
 MYSQL *connection_pool::GetConnection() {
-    MYSQL *con = NULL;
-
-    if (0 == connList.size()) {
-        // 若连接池为空则返回NULL
+    if (m_MaxConn <= 0) {
         return NULL;
     }
 
-    // 取出连接，信号量原子操作-1，为0则进行等待
-    reserve.wait();
+    // 先尝试不等待地取，取不到再计时等待
+    if (reserve.trywait()) {
+        metrics::observe(H_DB_WAIT, 0);
+    } else {
+        struct timeval begin, end;
+        gettimeofday(&begin, NULL);
+        bool ok = reserve.timewait(m_timeout);
+        gettimeofday(&end, NULL);
+        long long waited = (end.tv_sec - begin.tv_sec) * 1000000LL + (end.tv_usec - begin.tv_usec);
+        metrics::observe(H_DB_WAIT, waited > 0 ? waited : 0);
 
-    // 上锁
-    lock.lock();
+        lock.lock();
+        ++m_waits;
+        m_wait_us += waited;
+        m_last_busy = end.tv_sec;
+        if (!ok) {
+            ++m_timeouts;
+        }
+        lock.unlock();
 
-    // 取出一个连接
-    con = connList.front();
+        if (!ok) {
+            LOG_WARN("get mysql connection timeout after %d ms", m_timeout);
+            return NULL;
+        }
+    }
+
+    // 上锁，取出一个连接
+    lock.lock();
+    idle_conn ic = connList.front();
     connList.pop_front();
 
     // 更新变量
     --m_FreeConn;
     ++m_CurConn;
-
-    // 解锁
     lock.unlock();
+
+    // 空闲过久的连接可能已被服务端断开，先探活，失败则透明重连
+    if (time(NULL) - ic.idle_since >= PING_IDLE && mysql_ping(ic.con) != 0) {
+        LOG_WARN("mysql connection lost: %s, reconnecting", mysql_error(ic.con));
+        mysql_close(ic.con);
+        ic.con = connect();
+        if (ic.con == NULL) {
+            lock.lock();
+            --m_CurConn;
+            lock.unlock();
+            return NULL;
+        }
+    }
     // 返回获得的数据库连接
-    return con;
+    return ic.con;
 }
 
 // 释放当前使用的连接
@@ -96,33 +171,141 @@ bool connection_pool::ReleaseConnection(MYSQL *con) {
         return false;
     }
 
-    // 上锁
+    // 使用过程中发现连接已断开，直接丢弃，由维护线程补足
+    if (IsBroken(con)) {
+        DiscardConnection(con);
+        return true;
+    }
+
+    // 释放连接，将连接重新放入链表中，信号量原子操作+1
     lock.lock();
+    --m_CurConn;
+    lock.unlock();
+    put_idle(con);
+    return true;
+}
 
-    // 释放连接，将连接重新放入链表中
-    connList.push_back(con);
-    // 更新变量
-    ++m_FreeConn;
+// 调用方已确认连接不可用(如探活失败)，无论错误码如何都不再放回空闲链表
+void connection_pool::DiscardConnection(MYSQL *con) {
+    if (NULL == con) {
+        return;
+    }
+    mysql_close(con);
+    lock.lock();
     --m_CurConn;
+    lock.unlock();
+}
 
-    // 解锁
+bool connection_pool::IsBroken(MYSQL *con) {
+    unsigned int err = mysql_errno(con);
+    return err == CR_SERVER_GONE || err == CR_SERVER_LOST;
+}
+
+void *connection_pool::maintain_thread(void *arg) {
+    ((connection_pool *) arg)->maintain();
+    return NULL;
+}
+
+void connection_pool::maintain() {
+    while (!m_stop.load()) {
+        sleep(1);
+        time_t now = time(NULL);
+        check_idle(now);
+        resize(now);
+    }
+}
+
+// 空闲链表按归还顺序排列，表头最旧，只需检查到第一个不够旧的连接为止
+void connection_pool::check_idle(time_t now) {
+    while (!m_stop.load() && reserve.trywait()) {
+        lock.lock();
+        idle_conn ic = connList.front();
+        if (now - ic.idle_since < PING_IDLE) {
+            lock.unlock();
+            reserve.post();
+            break;
+        }
+        connList.pop_front();
+        --m_FreeConn;
+        lock.unlock();
+
+        if (mysql_ping(ic.con) != 0) {
+            LOG_WARN("idle mysql connection lost: %s, reconnecting", mysql_error(ic.con));
+            mysql_close(ic.con);
+            ic.con = connect();
+            if (ic.con == NULL) {
+                // 数据库不可用，下个周期由resize补足
+                break;
+            }
+        }
+        put_idle(ic.con);
+    }
+}
+
+void connection_pool::resize(time_t now) {
+    lock.lock();
+    long waits = m_waits;
+    long timeouts = m_timeouts;
+    long long wait_us = m_wait_us;
+    time_t last_busy = m_last_busy;
+    int total = m_CurConn + m_FreeConn;
+    int free_conn = m_FreeConn;
+    m_waits = 0;
+    m_timeouts = 0;
+    m_wait_us = 0;
     lock.unlock();
 
-    // 释放连接信号量原子操作+1
-    reserve.post();
-    return true;
+    // 低于下限时补足；上个周期出现超时或平均等待过长时按当前规模的一半扩容
+    int grow = 0;
+    if (total < m_MinConn) {
+        grow = m_MinConn - total;
+    } else if (total < m_MaxConn && (timeouts > 0 || (waits > 0 && wait_us / waits > SLOW_WAIT_US))) {
+        grow = total / 2 > 1 ? total / 2 : 1;
+        if (grow > m_MaxConn - total) {
+            grow = m_MaxConn - total;
+        }
+    }
+    if (grow > 0) {
+        int i = 0;
+        for (; i < grow && !m_stop.load(); ++i) {
+            MYSQL *con = connect();
+            if (con == NULL) {
+                break;
+            }
+            put_idle(con);
+        }
+        LOG_INFO("mysql pool grow %d -> %d (waits %ld, timeouts %ld)", total, total + i, waits, timeouts);
+        return;
+    }
+
+    // 持续一段时间没有等待，每个周期关闭一条多余的空闲连接
+    if (total > m_MinConn && free_conn > 0 && now - last_busy >= SHRINK_IDLE && reserve.trywait()) {
+        lock.lock();
+        MYSQL *con = connList.front().con;
+        connList.pop_front();
+        --m_FreeConn;
+        lock.unlock();
+        mysql_close(con);
+        LOG_INFO("mysql pool shrink %d -> %d", total, total - 1);
+    }
 }
 
 // 销毁数据库连接池
 void connection_pool::DestroyPool() {
+    // 先停止维护线程
+    m_stop.store(true);
+    if (m_running) {
+        pthread_join(m_maintainer, NULL);
+        m_running = false;
+    }
+
     // 上锁
     lock.lock();
     if (connList.size() > 0) {
         // 通过迭代器遍历，关闭数据库连接
-        list<MYSQL *>::iterator it;
+        list<idle_conn>::iterator it;
         for (it = connList.begin(); it != connList.end(); ++it) {
-            MYSQL *con = *it;
-            mysql_close(con);
+            mysql_close(it->con);
         }
         m_CurConn = 0;
         m_FreeConn = 0;
@@ -139,6 +322,10 @@ int connection_pool::GetFreeConn() {
     return this->m_FreeConn;
 }
 
+int connection_pool::GetCurConn() {
+    return this->m_CurConn;
+}
+
 // RAII机制销毁连接池（RAII机制：实现资源申请、释放的成对操作）
 connection_pool::~connection_pool() {
     DestroyPool();
@@ -156,4 +343,4 @@ connectionRAII::connectionRAII(MYSQL **SQL, connection_pool *connPool) {
 // 通过析构函数实现释放连接
 connectionRAII::~connectionRAII() {
     poolRAII->ReleaseConnection(conRAII);
-}
\ No newline at end of file
+}
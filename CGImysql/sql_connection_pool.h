@@ -6,8 +6,10 @@
 #include <mysql/mysql.h>
 #include <error.h>
 #include <string.h>
+#include <time.h>
 #include <iostream>
 #include <string>
+#include <atomic>
 #include "../lock/locker.h"
 #include "../log/log.h"
 
@@ -15,31 +17,75 @@ using namespace std;
 
 class connection_pool {
 public:
-    MYSQL *GetConnection();                 // 获取数据库连接
+    static const int PING_IDLE = 30;        // 空闲超过该秒数的连接在使用前先mysql_ping
+
+    MYSQL *GetConnection();                 // 获取数据库连接，超时返回NULL
     bool ReleaseConnection(MYSQL *conn);    // 释放连接
+    void DiscardConnection(MYSQL *conn);    // 关闭已失效的连接，不放回连接池
     int GetFreeConn();                      // 获取连接
+    int GetCurConn();                       // 正在使用的连接数
     void DestroyPool();                     // 销毁所有连接
 
     // 局部静态变量单例模式
     static connection_pool *GetInstance();
 
-    void init(string url, string User, string PassWord, string DataBaseName, int Port, int MaxConn, int close_log);
+    // 连接是否已被服务端断开
+    static bool IsBroken(MYSQL *conn);
+
+    // MaxConn为连接数上限，MinConn为保底连接数，timeout_ms为获取连接的最长等待时间
+    void init(string url, string User, string PassWord, string DataBaseName, int Port, int MaxConn, int close_log,
+              int MinConn = 0, int timeout_ms = 500);
 
 private:
     connection_pool();
 
     ~connection_pool();
 
+    // 空闲连接及其开始空闲的时间
+    struct idle_conn {
+        MYSQL *con;
+        time_t idle_since;
+    };
+
+    // 新建一条连接，失败返回NULL
+    MYSQL *connect();
+
+    // 放回空闲链表并唤醒一个等待者
+    void put_idle(MYSQL *con);
+
+    // 后台维护线程：健康检查、断线重连、弹性伸缩
+    static void *maintain_thread(void *arg);
+
+    void maintain();
+
+    // 对空闲过久的连接执行mysql_ping，失败则重连
+    void check_idle(time_t now);
+
+    // 根据等待情况扩容或缩容
+    void resize(time_t now);
+
     int m_MaxConn;  // 最大连接数
+    int m_MinConn;  // 最小连接数
     int m_CurConn;  // 当前已使用的连接数
     int m_FreeConn; // 当前空闲的连接数
+    int m_timeout;  // 获取连接的超时时间(ms)
     locker lock;
-    list<MYSQL *> connList; // 连接池
-    sem reserve;  // 信号量
+    list<idle_conn> connList; // 连接池
+    sem reserve;  // 信号量，与空闲连接数保持一致
+
+    // 等待指标，由维护线程周期性读取并清零
+    long m_waits;      // 需要等待才拿到连接的次数
+    long m_timeouts;   // 等待超时的次数
+    long long m_wait_us;  // 累计等待时间
+    time_t m_last_busy;   // 最近一次出现等待的时间
+
+    atomic<bool> m_stop;   // 析构时通知维护线程退出
+    bool m_running;
+    pthread_t m_maintainer;
 
 public:
     string m_url;             // 主机地址
-    string m_Port;         // 数据库端口号
+    int m_Port;            // 数据库端口号
     string m_User;         // 登陆数据库用户名
     string m_PassWord;     // 登陆数据库密码
     string m_DatabaseName; // 使用数据库名
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include "user_snapshot.h"
+#include "user_table.h"
+
+using namespace std;
+
+static const char SNAPSHOT_MAGIC[8] = {'T', 'W', 'S', 'U', 'S', 'E', 'R', '\0'};
+
+user_snapshot::user_snapshot() {
+    m_base = NULL;
+    m_length = 0;
+    m_header = NULL;
+    m_index = NULL;
+    m_blob = NULL;
+}
+
+user_snapshot::~user_snapshot() {
+    close();
+}
+
+bool user_snapshot::open(const char *path) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(header)) {
+        ::close(fd);
+        return false;
+    }
+
+    // 只读共享映射，页面按需加载，多进程共享page cache
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    const header *h = (const header *) addr;
+    size_t length = st.st_size;
+    // 校验文件头和各段边界，任何不一致都视为快照不可用
+    bool ok = memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+              && h->version == VERSION
+              && h->header_size == sizeof(header)
+              && h->file_size == length
+              && h->capacity > 0 && (h->capacity & (h->capacity - 1)) == 0
+              && h->count < h->capacity
+              && h->index_offset == sizeof(header)
+              && h->blob_offset == h->index_offset + h->capacity * sizeof(slot)
+              && h->blob_offset + h->blob_size == length;
+    if (!ok) {
+        munmap(addr, length);
+        return false;
+    }
+
+    m_base = (char *) addr;
+    m_length = length;
+    m_header = h;
+    m_index = (const slot *) (m_base + h->index_offset);
+    m_blob = m_base + h->blob_offset;
+    return true;
+}
+
+void user_snapshot::close() {
+    if (m_base) {
+        munmap(m_base, m_length);
+    }
+    m_base = NULL;
+    m_length = 0;
+    m_header = NULL;
+    m_index = NULL;
+    m_blob = NULL;
+}
+
+// 取出偏移处的记录，越界返回NULL
+const char *user_snapshot::record(uint64_t offset, uint16_t *name_len) const {
+    if (offset == 0 || offset - 1 + 4 > m_header->blob_size) {
+        return NULL;
+    }
+    const char *rec = m_blob + offset - 1;
+    uint16_t nlen, plen;
+    memcpy(&nlen, rec, 2);
+    memcpy(&plen, rec + 2, 2);
+    if (offset - 1 + 4 + nlen + plen + 2 > m_header->blob_size) {
+        return NULL;
+    }
+    *name_len = nlen;
+    return rec + 4;
+}
+
+const char *user_snapshot::find(const char *name, size_t len, uint64_t h) const {
+    if (!m_header) {
+        return NULL;
+    }
+    uint64_t mask = m_header->capacity - 1;
+    for (uint64_t i = h & mask, n = 0; n <= mask; i = (i + 1) & mask, ++n) {
+        const slot &s = m_index[i];
+        if (s.offset == 0) {
+            return NULL;
+        }
+        if (s.hash != h) {
+            continue;
+        }
+        uint16_t nlen;
+        const char *rec = record(s.offset, &nlen);
+        if (rec && nlen == len && memcmp(rec, name, len) == 0) {
+            return rec + nlen + 1;
+        }
+    }
+    return NULL;
+}
+
+void user_snapshot::for_each(void (*fn)(const char *, const char *, void *), void *arg) const {
+    if (!m_header) {
+        return;
+    }
+    for (uint64_t i = 0; i < m_header->capacity; ++i) {
+        uint16_t nlen;
+        const char *rec = record(m_index[i].offset, &nlen);
+        if (rec) {
+            fn(rec, rec + nlen + 1, arg);
+        }
+    }
+}
+
+struct snapshot_item {
+    const char *name;
+    const char *passwd;
+};
+
+static void collect(const char *name, const char *passwd, void *arg) {
+    snapshot_item item = {name, passwd};
+    ((vector<snapshot_item> *) arg)->push_back(item);
+}
+
+bool user_snapshot::write(const char *path, const user_table &table, uint64_t max_id) {
+    vector<snapshot_item> items;
+    table.for_each(collect, &items);
+
+    // 负载因子不超过0.5
+    uint64_t capacity = 16;
+    while (capacity < items.size() * 2) {
+        capacity <<= 1;
+    }
+
+    vector<slot> index(capacity);
+    memset(&index[0], 0, capacity * sizeof(slot));
+    uint64_t blob_size = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        size_t nlen = strlen(items[i].name);
+        uint64_t h = user_table::hash(items[i].name, nlen);
+        uint64_t j = h & (capacity - 1);
+        while (index[j].offset) {
+            j = (j + 1) & (capacity - 1);
+        }
+        index[j].hash = h;
+        index[j].offset = blob_size + 1;
+        blob_size += 4 + nlen + strlen(items[i].passwd) + 2;
+    }
+
+    header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    h.version = VERSION;
+    h.header_size = sizeof(header);
+    h.count = items.size();
+    h.capacity = capacity;
+    h.max_id = max_id;
+    h.index_offset = sizeof(header);
+    h.blob_offset = h.index_offset + capacity * sizeof(slot);
+    h.blob_size = blob_size;
+    h.file_size = h.blob_offset + blob_size;
+
+    char tmp_path[256];
+    // 多进程模式下各进程可能同时写快照，临时文件按进程区分
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int) getpid());
+    FILE *fp = fopen(tmp_path, "wb");
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1
+              && fwrite(&index[0], sizeof(slot), capacity, fp) == capacity;
+    // 记录写入顺序与建索引时的偏移顺序一致
+    for (size_t i = 0; ok && i < items.size(); ++i) {
+        uint16_t lens[2] = {(uint16_t) strlen(items[i].name), (uint16_t) strlen(items[i].passwd)};
+        ok = fwrite(lens, sizeof(lens), 1, fp) == 1
+             && fwrite(items[i].name, lens[0] + 1, 1, fp) == 1
+             && fwrite(items[i].passwd, lens[1] + 1, 1, fp) == 1;
+    }
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef _USER_SNAPSHOT_
+#define _USER_SNAPSHOT_
+
+#include <stddef.h>
+#include <stdint.h>
+
+class user_table;
+
+/**
+ * 用户表的持久化快照，启动时只读 mmap 映射，不再全量执行 SELECT 构建内存表
+ * 文件布局：
+ *      header | index[capacity] | blob
+ *      - index 为线性探测的开放寻址表，每个槽位记录 hash 与记录在 blob 中的偏移(+1，0表示空)
+ *      - blob 中每条记录为 uint16 name_len, uint16 passwd_len, name'\0', passwd'\0'
+ * 多个进程映射同一个快照时共享page cache，常驻内存只随实际访问的页增长
+ * **/
+class user_snapshot {
+public:
+    static const uint32_t VERSION = 1;
+
+    struct header {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_size;
+        uint64_t count;         // 记录数
+        uint64_t capacity;      // 索引槽位数，2的幂
+        uint64_t max_id;        // 快照包含的最大user.id，启动后从这里开始追平
+        uint64_t index_offset;
+        uint64_t blob_offset;
+        uint64_t blob_size;
+        uint64_t file_size;
+    };
+
+    struct slot {
+        uint64_t hash;
+        uint64_t offset;
+    };
+
+    user_snapshot();
+
+    ~user_snapshot();
+
+    // 映射快照文件，文件不存在、版本不符或布局损坏均返回false
+    bool open(const char *path);
+
+    void close();
+
+    bool is_open() const { return m_base != NULL; }
+
+    // 查找用户，返回密码，找不到返回NULL
+    const char *find(const char *name, size_t len, uint64_t h) const;
+
+    // 遍历所有记录
+    void for_each(void (*fn)(const char *name, const char *passwd, void *arg), void *arg) const;
+
+    uint64_t max_id() const { return m_header ? m_header->max_id : 0; }
+
+    uint64_t size() const { return m_header ? m_header->count : 0; }
+
+    // 将用户表（含其挂载的快照）合并写成新的快照，先写临时文件再rename，保证读者只看到完整文件
+    static bool write(const char *path, const user_table &table, uint64_t max_id);
+
+private:
+    const char *record(uint64_t offset, uint16_t *name_len) const;
+
+    char *m_base;
+    size_t m_length;
+    const header *m_header;
+    const slot *m_index;
+    const char *m_blob;
+};
+
+#endif
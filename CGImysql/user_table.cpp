@@ -0,0 +1,284 @@
+#include <stdlib.h>
+#include <string.h>
+#include "user_table.h"
+#include "user_snapshot.h"
+
+using namespace std;
+
+// 每个分片的初始槽位数，必须是2的幂
+static const size_t INIT_CAPACITY = 16;
+
+// erase留下的删除标记：槽位仍算占用，探测时跳过继续向后找，扩容时丢弃
+static user_entry s_tombstone;
+static user_entry *const TOMBSTONE = &s_tombstone;
+
+user_table::user_table() {
+    m_snapshot = NULL;
+    for (int i = 0; i < SHARD_NUM; ++i) {
+        m_shards[i].table.store(new_array(INIT_CAPACITY), memory_order_relaxed);
+        m_shards[i].count.store(0, memory_order_relaxed);
+    }
+}
+
+user_table::~user_table() {
+    for (int i = 0; i < SHARD_NUM; ++i) {
+        shard &s = m_shards[i];
+        slot_array *arr = s.table.load(memory_order_relaxed);
+        // 条目只挂在当前表上，旧表中的指针与当前表重复，不能重复释放
+        for (size_t j = 0; j <= arr->mask; ++j) {
+            user_entry *e = arr->slots[j].load(memory_order_relaxed);
+            if (e != TOMBSTONE) {
+                free(e);
+            }
+        }
+        delete[] arr->slots;
+        delete arr;
+
+        for (size_t j = 0; j < s.retired.size(); ++j) {
+            delete[] s.retired[j]->slots;
+            delete s.retired[j];
+        }
+        for (size_t j = 0; j < s.replaced.size(); ++j) {
+            free(s.replaced[j]);
+        }
+    }
+}
+
+// FNV-1a，用户名很短，足够均匀
+uint64_t user_table::hash(const char *s, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char) s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+user_table::slot_array *user_table::new_array(size_t capacity) {
+    slot_array *arr = new slot_array;
+    arr->mask = capacity - 1;
+    arr->slots = new atomic<user_entry *>[capacity];
+    for (size_t i = 0; i < capacity; ++i) {
+        arr->slots[i].store(NULL, memory_order_relaxed);
+    }
+    return arr;
+}
+
+// 线性探测找到第一个空槽位或删除标记放入条目，release 保证读者看到指针时条目内容已经完整
+// 复用删除标记时计数不变，返回是否占用了新的空槽位
+bool user_table::place(slot_array *arr, user_entry *e) {
+    size_t i = e->hash & arr->mask;
+    user_entry *cur;
+    while ((cur = arr->slots[i].load(memory_order_relaxed)) && cur != TOMBSTONE) {
+        i = (i + 1) & arr->mask;
+    }
+    arr->slots[i].store(e, memory_order_release);
+    return !cur;
+}
+
+// 扩容：构造新表，迁移完成后再发布，调用方需持有分片锁
+// 占满槽位的主要是删除标记(注册反复失败回滚)时按原大小重建，只清理标记，不翻倍
+void user_table::grow(shard &s) {
+    slot_array *old = s.table.load(memory_order_relaxed);
+    size_t capacity = old->mask + 1;
+    size_t live = 0;
+    for (size_t i = 0; i < capacity; ++i) {
+        user_entry *e = old->slots[i].load(memory_order_relaxed);
+        if (e && e != TOMBSTONE) {
+            ++live;
+        }
+    }
+    if (live * 20 > capacity * 7) {
+        capacity *= 2;
+    }
+    slot_array *arr = new_array(capacity);
+    for (size_t i = 0; i <= old->mask; ++i) {
+        user_entry *e = old->slots[i].load(memory_order_relaxed);
+        if (e && e != TOMBSTONE) {
+            place(arr, e);
+        }
+    }
+    // 删除标记不迁移，计数只剩有效条目
+    s.count.store(live, memory_order_relaxed);
+    s.table.store(arr, memory_order_release);
+    // 可能仍有读者在旧表上探测，延迟释放
+    s.retired.push_back(old);
+}
+
+const user_entry *user_table::lookup(const char *name, size_t len, uint64_t h) const {
+    const shard &s = m_shards[h >> (64 - SHARD_BITS)];
+    slot_array *arr = s.table.load(memory_order_acquire);
+    for (size_t i = h & arr->mask;; i = (i + 1) & arr->mask) {
+        user_entry *e = arr->slots[i].load(memory_order_acquire);
+        if (!e) {
+            return NULL;
+        }
+        if (e != TOMBSTONE && e->hash == h && e->name_len == len && memcmp(e->name(), name, len) == 0) {
+            return e;
+        }
+    }
+}
+
+atomic<user_entry *> *user_table::find_slot(slot_array *arr, const char *name, size_t len, uint64_t h) {
+    for (size_t i = h & arr->mask;; i = (i + 1) & arr->mask) {
+        user_entry *e = arr->slots[i].load(memory_order_relaxed);
+        if (!e) {
+            return NULL;
+        }
+        if (e != TOMBSTONE && e->hash == h && e->name_len == len && memcmp(e->name(), name, len) == 0) {
+            return &arr->slots[i];
+        }
+    }
+}
+
+user_entry *user_table::new_entry(const char *name, size_t len, const char *passwd, size_t plen, uint64_t h,
+                                  bool pending) {
+    user_entry *e = (user_entry *) malloc(sizeof(user_entry) + len + plen + 1);
+    e->hash = h;
+    e->name_len = (uint16_t) len;
+    e->passwd_len = (uint16_t) plen;
+    e->pending.store(pending, memory_order_relaxed);
+    memcpy(e->data, name, len + 1);
+    memcpy(e->data + len + 1, passwd, plen + 1);
+    return e;
+}
+
+void user_table::add(shard &s, user_entry *e) {
+    // 负载因子(含删除标记)超过0.7时扩容，扩容会丢弃删除标记并重写计数
+    if ((s.count.load(memory_order_relaxed) + 1) * 10 > (s.table.load(memory_order_relaxed)->mask + 1) * 7) {
+        grow(s);
+    }
+    if (place(s.table.load(memory_order_relaxed), e)) {
+        s.count.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+bool user_table::verify(const char *name, const char *passwd) const {
+    size_t len = strlen(name);
+    uint64_t h = hash(name, len);
+    const user_entry *e = lookup(name, len, h);
+    if (e) {
+        return !e->pending.load(memory_order_acquire) && strcmp(e->passwd(), passwd) == 0;
+    }
+    const char *saved = m_snapshot ? m_snapshot->find(name, len, h) : NULL;
+    return saved && strcmp(saved, passwd) == 0;
+}
+
+bool user_table::contains(const char *name) const {
+    size_t len = strlen(name);
+    uint64_t h = hash(name, len);
+    return lookup(name, len, h) != NULL || (m_snapshot && m_snapshot->find(name, len, h) != NULL);
+}
+
+bool user_table::insert(const char *name, const char *passwd) {
+    return insert(name, passwd, false);
+}
+
+bool user_table::reserve(const char *name, const char *passwd) {
+    return insert(name, passwd, true);
+}
+
+bool user_table::insert(const char *name, const char *passwd, bool pending) {
+    size_t len = strlen(name);
+    size_t plen = strlen(passwd);
+    if (len > 0xffff || plen > 0xffff) {
+        return false;
+    }
+    uint64_t h = hash(name, len);
+    // 快照只读，不需要加锁
+    if (m_snapshot && m_snapshot->find(name, len, h)) {
+        return false;
+    }
+    shard &s = m_shards[h >> (64 - SHARD_BITS)];
+
+    s.lock.lock();
+    // 持锁后再查一次，防止同名用户并发注册
+    if (lookup(name, len, h)) {
+        s.lock.unlock();
+        return false;
+    }
+    add(s, new_entry(name, len, passwd, plen, h, pending));
+    s.lock.unlock();
+    return true;
+}
+
+void user_table::confirm(const char *name) {
+    size_t len = strlen(name);
+    const user_entry *e = lookup(name, len, hash(name, len));
+    if (e) {
+        e->pending.store(false, memory_order_release);
+    }
+}
+
+void user_table::put(const char *name, const char *passwd) {
+    size_t len = strlen(name);
+    size_t plen = strlen(passwd);
+    if (len > 0xffff || plen > 0xffff) {
+        return;
+    }
+    uint64_t h = hash(name, len);
+    shard &s = m_shards[h >> (64 - SHARD_BITS)];
+    user_entry *e = new_entry(name, len, passwd, plen, h);
+
+    s.lock.lock();
+    atomic<user_entry *> *slot = find_slot(s.table.load(memory_order_relaxed), name, len, h);
+    if (slot) {
+        // 覆盖旧条目，旧条目可能仍被读者持有，延迟释放
+        s.replaced.push_back(slot->load(memory_order_relaxed));
+        slot->store(e, memory_order_release);
+    } else {
+        add(s, e);
+    }
+    s.lock.unlock();
+}
+
+bool user_table::erase(const char *name) {
+    size_t len = strlen(name);
+    uint64_t h = hash(name, len);
+    shard &s = m_shards[h >> (64 - SHARD_BITS)];
+
+    s.lock.lock();
+    atomic<user_entry *> *slot = find_slot(s.table.load(memory_order_relaxed), name, len, h);
+    if (!slot) {
+        s.lock.unlock();
+        return false;
+    }
+    // 换成删除标记而不是置空，否则会截断经过该槽位的探测链；条目可能仍被读者持有，延迟释放
+    s.replaced.push_back(slot->load(memory_order_relaxed));
+    slot->store(TOMBSTONE, memory_order_release);
+    s.lock.unlock();
+    return true;
+}
+
+// 跳过已被哈希表覆盖的快照条目
+void user_table::visit_snapshot(const char *name, const char *passwd, void *arg) {
+    shadow_arg *sa = (shadow_arg *) arg;
+    size_t len = strlen(name);
+    if (!sa->table->lookup(name, len, hash(name, len))) {
+        sa->fn(name, passwd, sa->arg);
+    }
+}
+
+void user_table::for_each(void (*fn)(const char *, const char *, void *), void *arg) const {
+    for (int i = 0; i < SHARD_NUM; ++i) {
+        slot_array *arr = m_shards[i].table.load(memory_order_acquire);
+        for (size_t j = 0; j <= arr->mask; ++j) {
+            user_entry *e = arr->slots[j].load(memory_order_acquire);
+            if (e && e != TOMBSTONE && !e->pending.load(memory_order_acquire)) {
+                fn(e->name(), e->passwd(), arg);
+            }
+        }
+    }
+    if (m_snapshot) {
+        shadow_arg sa = {this, fn, arg};
+        m_snapshot->for_each(visit_snapshot, &sa);
+    }
+}
+
+size_t user_table::size() const {
+    size_t total = 0;
+    for (int i = 0; i < SHARD_NUM; ++i) {
+        total += m_shards[i].count.load(memory_order_relaxed);
+    }
+    return total;
+}
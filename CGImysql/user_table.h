@@ -0,0 +1,123 @@
+#ifndef _USER_TABLE_
+#define _USER_TABLE_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include "../lock/locker.h"
+
+using namespace std;
+
+class user_snapshot;
+
+// 用户名 + 密码条目，插入后只读(pending除外)，name 与 passwd 依次存放在 data 中，均以'\0'结尾
+struct user_entry {
+    uint64_t hash;
+    uint16_t name_len;
+    uint16_t passwd_len;
+    mutable atomic<bool> pending;  // 注册占用、数据库尚未写入，不能登录也不写入快照
+    char data[1];
+
+    const char *name() const { return data; }
+
+    const char *passwd() const { return data + name_len + 1; }
+};
+
+/**
+ * 分片的并发用户表，替代原来全局的 map<string, string> users
+ *      - 按哈希高位分成 SHARD_NUM 个分片，每个分片单独占一个cache line，避免伪共享
+ *      - 分片内部为线性探测的开放寻址哈希表，槽位为 atomic<user_entry *>
+ *      - 读（登录校验）完全无锁：acquire 读取表指针和槽位即可
+ *      - 写（注册）只锁对应分片；扩容时构造新表后整体发布，旧表与被替换的条目延迟到析构时释放，
+ *        因此并发读者永远不会访问到已释放的内存
+ *      - 可挂载一个只读的 user_snapshot，哈希表中只保存快照之后新增的用户，查找时先查哈希表再查快照
+ * **/
+class user_table {
+public:
+    static const int SHARD_BITS = 6;
+    static const int SHARD_NUM = 1 << SHARD_BITS;
+
+    user_table();
+
+    ~user_table();
+
+    // 登录校验，用户存在且密码一致返回true
+    bool verify(const char *name, const char *passwd) const;
+
+    // 用户是否存在
+    bool contains(const char *name) const;
+
+    // 插入用户，已存在则返回false
+    bool insert(const char *name, const char *passwd);
+
+    // 注册时占用用户名，已存在(含其他注册占用中)则返回false；
+    // 写数据库成功后confirm转为正式用户，失败时erase回滚，在此之前verify和for_each都跳过该条目
+    bool reserve(const char *name, const char *passwd);
+
+    void confirm(const char *name);
+
+    // 从数据库追平时使用：存在则覆盖密码，不检查快照
+    void put(const char *name, const char *passwd);
+
+    // 删除哈希表中的用户(不影响快照)，注册写数据库失败时回滚insert
+    bool erase(const char *name);
+
+    // 挂载只读快照，需在对外提供服务前调用
+    void attach(const user_snapshot *snapshot) { m_snapshot = snapshot; }
+
+    // 遍历所有用户(不含注册占用中的)，哈希表中的条目会覆盖快照中的同名条目
+    void for_each(void (*fn)(const char *name, const char *passwd, void *arg), void *arg) const;
+
+    // 哈希表中（快照之外）的用户数，erase删除的用户在被复用或下次扩容前仍计入
+    size_t size() const;
+
+    static uint64_t hash(const char *s, size_t len);
+
+private:
+    struct slot_array {
+        size_t mask;
+        atomic<user_entry *> *slots;
+    };
+
+    struct alignas(64) shard {
+        atomic<slot_array *> table;
+        locker lock;
+        atomic<size_t> count;
+        vector<slot_array *> retired;  // 扩容后被替换下来的旧表
+        vector<user_entry *> replaced; // put覆盖下来的旧条目
+    };
+
+    const user_entry *lookup(const char *name, size_t len, uint64_t h) const;
+
+    // 持有分片锁时查找条目所在槽位
+    static atomic<user_entry *> *find_slot(slot_array *arr, const char *name, size_t len, uint64_t h);
+
+    static user_entry *new_entry(const char *name, size_t len, const char *passwd, size_t plen, uint64_t h,
+                                 bool pending = false);
+
+    bool insert(const char *name, const char *passwd, bool pending);
+
+    // 持有分片锁时放入新条目，必要时扩容
+    void add(shard &s, user_entry *e);
+
+    struct shadow_arg {
+        const user_table *table;
+        void (*fn)(const char *, const char *, void *);
+        void *arg;
+    };
+
+    static void visit_snapshot(const char *name, const char *passwd, void *arg);
+
+    static slot_array *new_array(size_t capacity);
+
+    static bool place(slot_array *arr, user_entry *e);
+
+    void grow(shard &s);
+
+    shard m_shards[SHARD_NUM];
+    const user_snapshot *m_snapshot;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sched.h>
+#include <algorithm>
+#include "affinity.h"
+
+bool affinity::parse_list(const char *spec, vector<int> &cpus) {
+    const char *p = spec;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if (end == p) {
+            return false;
+        }
+        long hi = lo;
+        p = end;
+        if ('-' == *p) {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo) {
+                return false;
+            }
+            p = end;
+        }
+        for (long c = lo; c <= hi; ++c) {
+            cpus.push_back((int) c);
+        }
+        if (',' == *p) {
+            ++p;
+        } else if (*p && '\n' != *p) {
+            return false;
+        } else {
+            break;
+        }
+    }
+    return true;
+}
+
+// 中断名称在行末，如"eth1"或多队列网卡的"eth1-TxRx-0"；按整个名称匹配，eth1不匹配eth10
+static bool irq_line_matches(const char *line, const string &dev) {
+    size_t end = strlen(line);
+    while (end > 0 && isspace((unsigned char) line[end - 1])) {
+        --end;
+    }
+    size_t begin = end;
+    while (begin > 0 && !isspace((unsigned char) line[begin - 1])) {
+        --begin;
+    }
+    const char *name = line + begin;
+    size_t len = end - begin;
+    if (len < dev.size() || strncmp(name, dev.c_str(), dev.size()) != 0) {
+        return false;
+    }
+    return len == dev.size() || '-' == name[dev.size()];
+}
+
+bool affinity::irq_cpus(const string &dev, vector<int> &cpus) {
+    FILE *fp = fopen("/proc/interrupts", "r");
+    if (!fp) {
+        return false;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), fp)) {
+        char *colon = strchr(line, ':');
+        if (!colon || !irq_line_matches(colon, dev)) {
+            continue;
+        }
+        int irq = atoi(line);
+        if (irq <= 0 && '0' != line[strspn(line, " ")]) {
+            continue;  // NMI、LOC等非数字行
+        }
+        char path[64], list[256];
+        snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", irq);
+        FILE *af = fopen(path, "r");
+        if (!af) {
+            continue;
+        }
+        if (fgets(list, sizeof(list), af)) {
+            parse_list(list, cpus);
+        }
+        fclose(af);
+    }
+    fclose(fp);
+    sort(cpus.begin(), cpus.end());
+    cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+    return !cpus.empty();
+}
+
+bool affinity::resolve(const string &spec, vector<int> &cpus) {
+    cpus.clear();
+    bool ok;
+    if (spec.compare(0, 4, "irq:") == 0) {
+        ok = irq_cpus(spec.substr(4), cpus);
+    } else {
+        ok = parse_list(spec.c_str(), cpus);
+    }
+    long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+    for (size_t i = 0; ok && i < cpus.size(); ++i) {
+        ok = cpus[i] >= 0 && cpus[i] < ncpu && cpus[i] < CPU_SETSIZE;
+    }
+    return ok && !cpus.empty();
+}
+
+bool affinity::pin(pthread_t tid, const vector<int> &cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        CPU_SET(cpus[i], &set);
+    }
+    return pthread_setaffinity_np(tid, sizeof(set), &set) == 0;
+}
+
+int affinity::node_of(int cpu) {
+    for (int node = 0; node < 64; ++node) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0) {
+            return node;
+        }
+    }
+    return -1;
+}
+
+void affinity::partition(vector<int> &cpus, int index, int count) {
+    if (count <= 1 || cpus.empty()) {
+        return;
+    }
+    size_t n = cpus.size();
+    if (n < (size_t) count) {
+        cpus = vector<int>(1, cpus[index % n]);
+        return;
+    }
+    // 每个进程分到连续的一段，编号连续的CPU通常在同一NUMA节点
+    vector<int> part(cpus.begin() + index * n / count, cpus.begin() + (index + 1) * n / count);
+    cpus.swap(part);
+}
+
+string affinity::format(const vector<int> &cpus) {
+    string out;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), i ? ",%d" : "%d", cpus[i]);
+        out += buf;
+    }
+    return out;
+}
@@ -0,0 +1,42 @@
+/*************************************************************
+*CPU亲和性：把主线程、工作线程、日志线程绑定到指定的CPU
+*CPU列表写法与taskset -c相同，如"0-3,8"；工作线程还可以写"irq:网卡名"，
+*使用该网卡接收队列中断所在的CPU，让处理请求的线程与收包的CPU一致
+*不依赖libnuma：线程绑定后其私有缓冲区(指标分片、日志环形缓冲区)由自己首次写入，
+*按内核默认的首次访问策略分配在本地NUMA节点
+**************************************************************/
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class affinity {
+public:
+    // 解析CPU列表，或irq:网卡名；超出本机CPU数的编号视为错误
+    static bool resolve(const string &spec, vector<int> &cpus);
+
+    // 把线程绑定到cpus中的全部CPU
+    static bool pin(pthread_t tid, const vector<int> &cpus);
+
+    // CPU所在的NUMA节点，无法确定时返回-1
+    static int node_of(int cpu);
+
+    // 多进程模式下把列表平均分给count个进程，只保留第index份；CPU数少于进程数时轮流分配一个
+    static void partition(vector<int> &cpus, int index, int count);
+
+    // 格式化为"0,1,2"，用于日志
+    static string format(const vector<int> &cpus);
+
+private:
+    static bool parse_list(const char *spec, vector<int> &cpus);
+
+    // 从/proc/interrupts找名称为dev或以"dev-"开头的中断，合并其/proc/irq/N/smp_affinity_list
+    static bool irq_cpus(const string &dev, vector<int> &cpus);
+};
+
+#endif
@@ -4,7 +4,7 @@ Config::Config() {
     //端口号,默认9006
     PORT = 9006;
 
-    //日志写入方式，默认同步
+    //日志写入方式，默认同步，1为阻塞队列异步，2为每线程环形缓冲区异步
     LOGWrite = 0;
 
     //触发组合模式,默认listenfd LT + connfd LT
@@ -22,6 +22,12 @@ Config::Config() {
     //数据库连接池数量,默认8
     sql_num = 8;
 
+    //数据库连接池最小连接数,默认0表示与sql_num相同,即固定大小
+    sql_min_num = 0;
+
+    //数据库连接获取方式,默认每次从连接池借用,1为工作线程独占连接
+    sql_mode = 0;
+
     //线程池内的线程数量,默认8
     thread_num = 8;
 
@@ -30,11 +36,61 @@ Config::Config() {
 
     //并发模型,默认是proactor
     actor_model = 0;
+
+    //用户表快照,默认使用
+    user_snapshot = 1;
+
+    //日志格式,默认文本,1为二进制,需用log_decode还原
+    log_binary = 0;
+
+    //日志等级,默认1只输出info及以上,0为debug,运行时可用SIGUSR1/SIGUSR2调整
+    log_level = 1;
+
+    //单个日志文件的大小上限(MB),默认0不按大小切分
+    log_split_mb = 0;
+
+    //压缩切分出的日志文件,默认不压缩,1为后台调用gzip
+    log_gzip = 0;
+
+    //指标管理端口,默认0不开启,开启后可用curl http://127.0.0.1:端口/metrics采集
+    metrics_port = 0;
+
+    //慢请求阈值(ms),默认0不记录,超过时以WARN记录该请求各阶段耗时
+    slow_ms = 0;
+
+    //过载控制的目标排队时间(ms),默认0关闭,排队时间持续超过该值时对新请求回复503并暂停accept
+    overload_ms = 0;
+
+    //单个IP的最大连接数,默认0不限制,超过时回复429并关闭新连接
+    ip_conns = 0;
+
+    //单个IP每秒的请求数,默认0不限制,允许1秒的突发,超过时回复429
+    ip_rate = 0;
+
+    //绑定的CPU列表,写法同taskset -c,如0-3,8;工作线程可写irq:网卡名,使用该网卡中断所在的CPU;默认不绑定
+    loop_cpus = "";
+    worker_cpus = "";
+    log_cpus = "";
+
+    //socket调优选项,逗号分隔,如nodelay,sndbuf=262144,busy_poll=50,fastopen=256,cork;默认不设置
+    sock_opts = "";
+
+    //热重启交接路径,默认空关闭;新进程以相同路径启动时从旧进程接收监听socket,旧进程排空连接后退出
+    handoff_path = "";
+
+    //多进程模式的工作进程数,默认0单进程;每个工作进程有独立的epoll、线程池、定时器和日志文件
+    processes = 0;
+
+    //共享内存统计段,默认1开启;/dev/shm/tinyweb.端口,由tinytop读取
+    stats = 1;
+
+    //静态文件的Cache-Control规则,默认空不发送;格式"路径前缀=取值;...",如"/=no-cache;/frame.jpg=max-age=86400"
+    cache_control = "";
 }
 
 void Config::parse_arg(int argc, char *argv[]) {
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:n:d:t:c:a:u:b:v:r:g:e:q:w:k:f:x:y:z:j:i:h:S:C:";
     while ((opt = getopt(argc, argv, str)) != -1) {
         switch (opt) {
             case 'p': {
@@ -57,6 +113,14 @@ void Config::parse_arg(int argc, char *argv[]) {
                 sql_num = atoi(optarg);
                 break;
             }
+            case 'n': {
+                sql_min_num = atoi(optarg);
+                break;
+            }
+            case 'd': {
+                sql_mode = atoi(optarg);
+                break;
+            }
             case 't': {
                 thread_num = atoi(optarg);
                 break;
@@ -69,6 +133,78 @@ void Config::parse_arg(int argc, char *argv[]) {
                 actor_model = atoi(optarg);
                 break;
             }
+            case 'u': {
+                user_snapshot = atoi(optarg);
+                break;
+            }
+            case 'b': {
+                log_binary = atoi(optarg);
+                break;
+            }
+            case 'v': {
+                log_level = atoi(optarg);
+                break;
+            }
+            case 'r': {
+                log_split_mb = atoi(optarg);
+                break;
+            }
+            case 'g': {
+                log_gzip = atoi(optarg);
+                break;
+            }
+            case 'e': {
+                metrics_port = atoi(optarg);
+                break;
+            }
+            case 'q': {
+                slow_ms = atoi(optarg);
+                break;
+            }
+            case 'w': {
+                overload_ms = atoi(optarg);
+                break;
+            }
+            case 'k': {
+                ip_conns = atoi(optarg);
+                break;
+            }
+            case 'f': {
+                ip_rate = atoi(optarg);
+                break;
+            }
+            case 'x': {
+                loop_cpus = optarg;
+                break;
+            }
+            case 'y': {
+                worker_cpus = optarg;
+                break;
+            }
+            case 'z': {
+                log_cpus = optarg;
+                break;
+            }
+            case 'j': {
+                sock_opts = optarg;
+                break;
+            }
+            case 'i': {
+                handoff_path = optarg;
+                break;
+            }
+            case 'h': {
+                processes = atoi(optarg);
+                break;
+            }
+            case 'S': {
+                stats = atoi(optarg);
+                break;
+            }
+            case 'C': {
+                cache_control = optarg;
+                break;
+            }
             default:
                 break;
         }
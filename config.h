@@ -34,6 +34,12 @@ public:
     //数据库连接池数量
     int sql_num;
 
+    //数据库连接池最小连接数
+    int sql_min_num;
+
+    //数据库连接获取方式
+    int sql_mode;
+
     //线程池内的线程数量
     int thread_num;
 
@@ -42,6 +48,56 @@ public:
 
     //并发模型选择
     int actor_model;
+
+    //是否使用用户表快照
+    int user_snapshot;
+
+    //日志格式
+    int log_binary;
+
+    //日志等级
+    int log_level;
+
+    //单个日志文件的大小上限(MB)
+    int log_split_mb;
+
+    //是否压缩切分出的日志文件
+    int log_gzip;
+
+    //指标管理端口
+    int metrics_port;
+
+    //慢请求阈值(ms)
+    int slow_ms;
+
+    //过载控制的目标排队时间(ms)
+    int overload_ms;
+
+    //单个IP的最大连接数
+    int ip_conns;
+
+    //单个IP每秒的请求数
+    int ip_rate;
+
+    //主线程、工作线程、日志线程绑定的CPU列表
+    string loop_cpus;
+    string worker_cpus;
+    string log_cpus;
+
+    //socket调优选项
+    string sock_opts;
+
+    //热重启交接监听socket的路径
+    string handoff_path;
+
+    //多进程模式的工作进程数
+    int processes;
+
+    //共享内存统计段
+    int stats;
+
+    //静态文件的Cache-Control规则
+    string cache_control;
 };
 
 #endif
\ No newline at end of file
@@ -2,9 +2,11 @@
 
 #include <mysql/mysql.h>
 #include <fstream>
+#include <algorithm>
 
 // 定义http响应的一些状态信息
 const char *ok_200_title = "OK";
+const char *not_modified_304_title = "Not Modified";
 const char *error_400_title = "Bad Request";
 const char *error_400_form = "Your request has bad syntax or is inherently impossible to staisfy.\n";
 const char *error_403_title = "Forbidden";
@@ -13,40 +15,123 @@ const char *error_404_title = "Not Found";
 const char *error_404_form = "The requested file was not found on this server.\n";
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
+const char *error_503_title = "Service Unavailable";
+const char *error_503_form = "The server is overloaded, please retry later.\n";
+const char *error_429_title = "Too Many Requests";
+const char *error_429_form = "Too many requests from your address, please retry later.\n";
+
+// 用户名和密码，分片哈希表，登录校验无锁读，注册只锁单个分片
+user_table users;
+
+// 用户表快照，只读映射，新增用户保存在users的哈希表中
+user_snapshot users_snapshot;
+
+struct snapshot_task {
+    string path;
+    uint64_t max_id;
+    int close_log;
+};
+
+// 写快照的线程遍历全局的users和users_snapshot，退出前须等它结束，
+// 否则静态析构可能在它读取时释放哈希表、解除快照映射
+static pthread_t snapshot_tid;
+static bool snapshot_running = false;
+
+// 后台线程合并写出新快照，不阻塞启动
+static void *write_user_snapshot(void *arg) {
+    snapshot_task *task = (snapshot_task *) arg;
+    int m_close_log = task->close_log;
+    if (user_snapshot::write(task->path.c_str(), users, task->max_id)) {
+        LOG_INFO("user snapshot %s written, max id %llu", task->path.c_str(), (unsigned long long) task->max_id);
+    } else {
+        LOG_ERROR("user snapshot %s write failed", task->path.c_str());
+    }
+    delete task;
+    return NULL;
+}
 
-locker m_lock;
-// 用户名和密码
-map <string, string> users;
+void http_conn::initmysql_result(connection_pool *connPool, const char *snapshot_path, int close_log) {
+    m_close_log = close_log;
 
-void http_conn::initmysql_result(connection_pool *connPool) {
     // 先从连接池中取一个连接
     MYSQL *mysql = NULL;
     // 基于RAII机制在connPool中取出一个连接
     connectionRAII mysqlcon(&mysql, connPool);
+    if (!mysql) {
+        return;
+    }
 
-    // 在user表中检索username，passwd数据，浏览器端输入
-    // mysql_query 传入第一个是MYSQL对象，第二个是查询语句
-    if (mysql_query(mysql, "SELECT username,passwd FROM user")) {
-        LOG_ERROR("SELECT error:%s\n", mysql_error(mysql));
+    // 先映射上次的快照，只需要从快照记录的max_id开始追平
+    uint64_t from_id = 0;
+    if (snapshot_path && users_snapshot.open(snapshot_path)) {
+        users.attach(&users_snapshot);
+        from_id = users_snapshot.max_id();
+        LOG_INFO("user snapshot %s mapped, %llu users, max id %llu", snapshot_path,
+                 (unsigned long long) users_snapshot.size(), (unsigned long long) from_id);
     }
 
-    // 从表中检索完整的结果集
-    // mysql_store_result(&mysql)告诉句柄mysql，把查询的数据从服务器端取到客户端，然后缓存起来，放在句柄mysql里面
-    // 这里将结果通过result指针指出
-    MYSQL_RES *result = mysql_store_result(mysql);
+    char sql[128];
+    snprintf(sql, sizeof(sql), "SELECT id,username,passwd FROM user WHERE id > %llu", (unsigned long long) from_id);
+    if (mysql_query(mysql, sql)) {
+        // user表没有id列时无法增量追平，退回到全量加载，且不使用快照
+        LOG_WARN("incremental user load failed:%s, fall back to full load", mysql_error(mysql));
+        users.attach(NULL);
+        users_snapshot.close();
+
+        // 在user表中检索username，passwd数据，浏览器端输入
+        // mysql_query 传入第一个是MYSQL对象，第二个是查询语句
+        if (mysql_query(mysql, "SELECT username,passwd FROM user")) {
+            LOG_ERROR("SELECT error:%s\n", mysql_error(mysql));
+            return;
+        }
 
-    // 返回结果集中的列数
-    int num_fields = mysql_num_fields(result);
+        // 从表中检索完整的结果集
+        // mysql_store_result(&mysql)告诉句柄mysql，把查询的数据从服务器端取到客户端，然后缓存起来，放在句柄mysql里面
+        // 这里将结果通过result指针指出
+        MYSQL_RES *result = mysql_store_result(mysql);
 
-    // 返回所有字段结构的数组
-    MYSQL_FIELD *fields = mysql_fetch_fields(result);
+        // 从结果集中获取下一行，将对应的用户名和密码，存入用户表中
+        while (MYSQL_ROW row = mysql_fetch_row(result)) {
+            // 取出查询结果的每一行，第一个作为用户名，第二个作为密码
+            users.insert(row[0], row[1]);
+        }
+        mysql_free_result(result);
+        return;
+    }
 
-    // 从结果集中获取下一行，将对应的用户名和密码，存入map中
+    // 逐行读取快照之后新增的用户，不在客户端缓存整个结果集
+    MYSQL_RES *result = mysql_use_result(mysql);
+    uint64_t max_id = from_id;
+    size_t fresh = 0;
     while (MYSQL_ROW row = mysql_fetch_row(result)) {
-        // 取出查询结果的每一行，第一个作为用户名，第二个作为密码，并以键值对的形式保存
-        string temp1(row[0]);
-        string temp2(row[1]);
-        users[temp1] = temp2;
+        uint64_t id = strtoull(row[0], NULL, 10);
+        if (id > max_id) {
+            max_id = id;
+        }
+        users.put(row[1], row[2]);
+        ++fresh;
+    }
+    mysql_free_result(result);
+    LOG_INFO("caught up %lu users after id %llu", (unsigned long) fresh, (unsigned long long) from_id);
+
+    // 有新增用户时重写快照，下次启动只需追平之后的增量
+    if (snapshot_path && fresh > 0) {
+        snapshot_task *task = new snapshot_task;
+        task->path = snapshot_path;
+        task->max_id = max_id;
+        task->close_log = m_close_log;
+        if (pthread_create(&snapshot_tid, NULL, write_user_snapshot, task) == 0) {
+            snapshot_running = true;
+        } else {
+            delete task;
+        }
+    }
+}
+
+void http_conn::wait_snapshot() {
+    if (snapshot_running) {
+        pthread_join(snapshot_tid, NULL);
+        snapshot_running = false;
     }
 }
 
@@ -78,8 +163,8 @@ void addfd(int epollfd, int fd, bool one_shot, int TRIGMode) {
         // 判断是否开启EPOLLONESHOT
         event.events |= EPOLLONESHOT;
     }
+    // 连接由accept4以SOCK_NONBLOCK创建，已是非阻塞
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    setnonblocking(fd);  // 设置为非阻塞
 }
 
 // 从内核时间表删除描述符
@@ -101,8 +186,141 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode) {
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
-int http_conn::m_user_count = 0;
+atomic<int> http_conn::m_user_count(0);
 int http_conn::m_epollfd = -1;
+connection_pool *http_conn::m_connPool = NULL;
+int http_conn::m_sql_mode = 0;
+bool http_conn::m_prefork = false;
+int http_conn::m_slow_ms = 0;
+int http_conn::m_cork = 0;
+atomic<bool> http_conn::m_draining(false);
+vector<pair<string, string> > http_conn::m_cache_rules;
+
+static bool longer_prefix(const pair<string, string> &a, const pair<string, string> &b) {
+    return a.first.size() > b.first.size();
+}
+
+bool http_conn::set_cache_rules(const string &spec) {
+    m_cache_rules.clear();
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(';', start);
+        if (end == string::npos) {
+            end = spec.size();
+        }
+        string rule = spec.substr(start, end - start);
+        start = end + 1;
+        if (rule.empty()) {
+            continue;
+        }
+        size_t eq = rule.find('=');
+        if (eq == string::npos || 0 == eq || '/' != rule[0] || eq + 1 == rule.size()) {
+            m_cache_rules.clear();
+            return false;
+        }
+        m_cache_rules.push_back(make_pair(rule.substr(0, eq), rule.substr(eq + 1)));
+    }
+    stable_sort(m_cache_rules.begin(), m_cache_rules.end(), longer_prefix);
+    return true;
+}
+
+// 工作线程独占的数据库连接，首次访问数据库时获取，之后不再归还
+static __thread MYSQL *sticky_mysql = NULL;
+// 独占连接上次使用的时间，不在连接池中，需要自己探活
+static __thread time_t sticky_used = 0;
+
+// 按模式获取数据库连接：0从连接池借用，1使用工作线程独占的连接
+MYSQL *http_conn::acquire_mysql() {
+    if (1 == m_sql_mode) {
+        time_t now = time(NULL);
+        // 与连接池相同，空闲过久的连接可能已被服务端按wait_timeout断开，探活失败则关闭丢弃后重新获取；
+        // 探活失败的错误码不一定是2006/2013，不能交给ReleaseConnection判断，否则会放回空闲链表
+        if (sticky_mysql && now - sticky_used >= connection_pool::PING_IDLE && mysql_ping(sticky_mysql) != 0) {
+            m_connPool->DiscardConnection(sticky_mysql);
+            sticky_mysql = NULL;
+        }
+        if (!sticky_mysql) {
+            sticky_mysql = m_connPool->GetConnection();
+        }
+        sticky_used = now;
+        return sticky_mysql;
+    }
+    return m_connPool->GetConnection();
+}
+
+void http_conn::release_mysql(MYSQL *con) {
+    if (!con) {
+        return;
+    }
+    if (1 == m_sql_mode) {
+        // 独占连接已断开时交还连接池丢弃，下次访问数据库时重新获取
+        if (connection_pool::IsBroken(con)) {
+            m_connPool->ReleaseConnection(con);
+            sticky_mysql = NULL;
+        }
+        return;
+    }
+    m_connPool->ReleaseConnection(con);
+}
+
+int http_conn::query_passwd(MYSQL *con, const char *name, string &passwd) {
+    char escaped[2 * 100 + 1];
+    mysql_real_escape_string(con, escaped, name, strlen(name));
+    char sql[300];
+    snprintf(sql, sizeof(sql), "SELECT passwd FROM user WHERE username='%s' LIMIT 1", escaped);
+    if (mysql_query(con, sql)) {
+        LOG_ERROR("query user %s failed: %s", name, mysql_error(con));
+        return -1;
+    }
+    MYSQL_RES *result = mysql_store_result(con);
+    MYSQL_ROW row = result ? mysql_fetch_row(result) : NULL;
+    int found = row && row[0] ? 1 : 0;
+    if (found) {
+        passwd = row[0];
+    }
+    if (result) {
+        mysql_free_result(result);
+    }
+    return found;
+}
+
+int http_conn::insert_unique(MYSQL *con, const char *name, const char *sql_insert) {
+    // 锁名最长64字节，用用户名的哈希代替用户名
+    char lock_name[32];
+    snprintf(lock_name, sizeof(lock_name), "tinyweb.user.%016llx",
+             (unsigned long long) user_table::hash(name, strlen(name)));
+    char sql[64];
+    snprintf(sql, sizeof(sql), "SELECT GET_LOCK('%s', 5)", lock_name);
+    if (mysql_query(con, sql)) {
+        LOG_ERROR("register %s: lock failed: %s", name, mysql_error(con));
+        return -1;
+    }
+    MYSQL_RES *result = mysql_store_result(con);
+    MYSQL_ROW row = result ? mysql_fetch_row(result) : NULL;
+    bool locked = row && row[0] && atoi(row[0]) == 1;
+    if (result) {
+        mysql_free_result(result);
+    }
+    if (!locked) {
+        LOG_ERROR("register %s: lock timed out", name);
+        return -1;
+    }
+
+    // 持锁查重再写入，其他工作进程的同名注册在GET_LOCK处等待
+    string saved;
+    int ret = query_passwd(con, name, saved);
+    if (0 == ret && mysql_query(con, sql_insert)) {
+        LOG_ERROR("register %s failed: %s", name, mysql_error(con));
+        ret = -1;
+    }
+
+    // 连接断开时服务端也会自动释放
+    snprintf(sql, sizeof(sql), "SELECT RELEASE_LOCK('%s')", lock_name);
+    if (0 == mysql_query(con, sql) && (result = mysql_store_result(con))) {
+        mysql_free_result(result);
+    }
+    return ret;
+}
 
 // 关闭连接，关闭一个连接，客户总量减一
 void http_conn::close_conn(bool real_close) {
@@ -111,6 +329,7 @@ void http_conn::close_conn(bool real_close) {
         removefd(m_epollfd, m_sockfd);
         m_sockfd = -1;
         m_user_count--;
+        ip_limit::get_instance()->on_close(m_address.sin_addr.s_addr);
     }
 }
 
@@ -139,6 +358,7 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMo
 // check_state默认为分析请求行状态
 void http_conn::init() {
     mysql = NULL;
+    m_corked = false;
     bytes_to_send = 0;
     bytes_have_send = 0;
     m_check_state = CHECK_STATE_REQUESTLINE;
@@ -148,6 +368,9 @@ void http_conn::init() {
     m_version = 0;
     m_content_length = 0;
     m_host = 0;
+    m_if_none_match = 0;
+    m_if_modified_since = 0;
+    m_etag[0] = '\0';
     m_start_line = 0;
     m_checked_idx = 0;
     m_read_idx = 0;
@@ -160,6 +383,7 @@ void http_conn::init() {
     memset(m_read_buf, '\0', READ_BUFFER_SIZE);
     memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
     memset(m_real_file, '\0', FILENAME_LEN);
+    memset(&m_stage, 0, sizeof(m_stage));
 }
 
 // 从状态机，用于分析出一行内容
@@ -364,8 +588,16 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
         // 跳过空格和'\t'字符
         text += strspn(text, " \t");
         m_host = text;
+    } else if (strncasecmp(text, "If-None-Match:", 14) == 0) {
+        text += 14;
+        text += strspn(text, " \t");
+        m_if_none_match = text;
+    } else if (strncasecmp(text, "If-Modified-Since:", 18) == 0) {
+        text += 18;
+        text += strspn(text, " \t");
+        m_if_modified_since = text;
     } else {
-        LOG_INFO("oop!unknow header: %s", text);
+        LOG_DEBUG("oop!unknow header: %s", text);
     }
     return NO_REQUEST;
 }
@@ -402,7 +634,7 @@ http_conn::HTTP_CODE http_conn::process_read() {
         // m_start_line是每一个数据行在m_read_buf中的起始位置
         // m_checked_idx表示从状态机在m_read_buf中读取的位置
         m_start_line = m_checked_idx;
-        LOG_INFO("%s", text);
+        LOG_DEBUG("%s", text);
 
         // 主状态机的三种状态转移逻辑
         switch (m_check_state) {
@@ -451,6 +683,7 @@ http_conn::HTTP_CODE http_conn::process_read() {
  */
 // 处理请求
 http_conn::HTTP_CODE http_conn::do_request() {
+    m_stage.parsed = metrics::now_ns();
     // 将doc_root复制到m_real_file
     // 将初始化的m_real_file赋值为网站根目录doc_root
     strcpy(m_real_file, doc_root);
@@ -507,30 +740,60 @@ http_conn::HTTP_CODE http_conn::do_request() {
             strcat(sql_insert, password);
             strcat(sql_insert, "')");
 
-            if (users.find(name) == users.end()) {
-                // 若找不到name
-                // 向数据库中插入数据时，需要通过锁来同步数据
-                // 查询时上锁
-                m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
-                m_lock.unlock();
-
-                if (!res) {
-                    // 若没有查到重名，即校验成功，则进行登录
+            // 先在用户表中占用用户名，同名并发注册只有一个能成功，之后才写数据库；
+            // user表的username没有唯一约束，不能依赖数据库去重。占用期间不能登录，也不会写入快照
+            if (users.reserve(name, password)) {
+                // 只有注册需要访问数据库，到这里才获取连接
+                mysql = acquire_mysql();
+                if (!mysql) {
+                    // 数据库不可用（连接池获取超时）时快速失败，不阻塞工作线程
+                    LOG_ERROR("%s", "register failed: no mysql connection");
+                    users.erase(name);
+                    free(sql_insert);
+                    return INTERNAL_ERROR;
+                }
+
+                int res = 0;
+                if (m_prefork) {
+                    // 其他工作进程注册的用户不在本进程的用户表中，到数据库中加锁查重后再写入
+                    res = insert_unique(mysql, name, sql_insert);
+                } else if (mysql_query(mysql, sql_insert)) {
+                    LOG_ERROR("register %s failed: %s", name, mysql_error(mysql));
+                    res = -1;
+                }
+                release_mysql(mysql);
+                mysql = NULL;
+
+                if (0 == res) {
+                    // 写入成功，转为正式用户，进行登录
+                    users.confirm(name);
                     strcpy(m_url, "/log.html");
                 } else {
-                    // 若重名了则报错
+                    // 用户名已被其他工作进程注册或写数据库失败，回滚占用的用户名
+                    users.erase(name);
                     strcpy(m_url, "/registerError.html");
                 }
             } else {
                 // 若在原表中找到重名则报登陆错误
                 strcpy(m_url, "/registerError.html");
             }
+            free(sql_insert);
         } else if (*(p + 1) == '2') {
             // 如果是登录，直接判断
             // 若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-            if (users.find(name) != users.end() && users[name] == password) {
+            bool ok = users.verify(name, password);
+            // 多进程模式下该用户可能是在其他工作进程注册的，本地没有时回查数据库并缓存到本地用户表
+            if (!ok && m_prefork && !users.contains(name)) {
+                mysql = acquire_mysql();
+                string saved;
+                if (mysql && 1 == query_passwd(mysql, name, saved)) {
+                    users.put(name, saved.c_str());
+                    ok = saved == password;
+                }
+                release_mysql(mysql);
+                mysql = NULL;
+            }
+            if (ok) {
                 strcpy(m_url, "/welcome.html");
             } else {
                 strcpy(m_url, "/logError.html");
@@ -607,6 +870,16 @@ http_conn::HTTP_CODE http_conn::do_request() {
         return BAD_REQUEST;
     }
 
+    // GET静态文件带验证器，客户端缓存仍有效时回复304，不打开和映射文件
+    // POST返回的页面取决于登录注册结果，不参与缓存
+    if (GET == m_method) {
+        snprintf(m_etag, sizeof(m_etag), "\"%lx-%lx-%lx\"", (unsigned long) m_file_stat.st_ino,
+                 (unsigned long) m_file_stat.st_mtime, (unsigned long) m_file_stat.st_size);
+        if (not_modified()) {
+            return NOT_MODIFIED;
+        }
+    }
+
 
     int fd = open(m_real_file, O_RDONLY);
     /*
@@ -663,6 +936,13 @@ bool http_conn::write() {
         return true;
     }
 
+    // 带文件的响应：加塞后头部和文件内容按满报文段发送，全部写完再解除
+    if (m_cork && !m_corked && 2 == m_iv_count) {
+        int on = 1;
+        setsockopt(m_sockfd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+        m_corked = true;
+    }
+
     while (1) {
         /**
          * ssize_t writev(int filedes, const struct iovec *iov, int iovcnt);
@@ -689,6 +969,7 @@ bool http_conn::write() {
         }
 
         // 正常发送，temp为发送的字节数
+        metrics::inc(M_BYTES_SENT, temp);
         // 更新已发送字节数
         bytes_have_send += temp;
         // 更新剩余发送字节数
@@ -709,6 +990,12 @@ bool http_conn::write() {
 
         // 若数据已全部发送完
         if (bytes_to_send <= 0) {
+            if (m_corked) {
+                int off = 0;
+                setsockopt(m_sockfd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+                m_corked = false;
+            }
+            stage_finish();
             unmap();
             // 在epoll树上充值EPOLLONESHOT事件
             modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
@@ -725,6 +1012,51 @@ bool http_conn::write() {
     }
 }
 
+void http_conn::stage_finish() {
+    stage_times &s = m_stage;
+    if (0 == s.begin || 0 == s.built) {
+        return;
+    }
+    uint64_t now = metrics::now_ns();
+    // reject直接生成的503、429没有经过工作线程处理，中间各阶段时间为0，只计总耗时
+    if (0 == s.dequeue) {
+        metrics::observe(H_REQUEST, (now - s.begin) / 1000);
+        return;
+    }
+    // 请求行或请求头出错时不经过do_request，全部计入解析阶段
+    uint64_t parsed = s.parsed ? s.parsed : s.handled;
+    uint64_t queue = (s.dequeue - s.begin) / 1000;
+    uint64_t parse = (parsed - s.dequeue) / 1000;
+    uint64_t handle = (s.handled - parsed) / 1000;
+    uint64_t build = (s.built - s.handled) / 1000;
+    uint64_t send = (now - s.built) / 1000;
+    uint64_t total = (now - s.begin) / 1000;
+    metrics::observe(H_STAGE_QUEUE, queue);
+    metrics::observe(H_STAGE_PARSE, parse);
+    metrics::observe(H_STAGE_HANDLE, handle);
+    metrics::observe(H_STAGE_BUILD, build);
+    metrics::observe(H_STAGE_SEND, send);
+    metrics::observe(H_REQUEST, total);
+
+    if (m_slow_ms <= 0 || total < (uint64_t) m_slow_ms * 1000) {
+        return;
+    }
+    // 每个线程每秒最多记录10条，避免过载时日志本身成为瓶颈
+    static __thread time_t slow_sec = 0;
+    static __thread int slow_logged = 0;
+    time_t sec = (time_t) (now / 1000000000ULL);
+    if (sec != slow_sec) {
+        slow_sec = sec;
+        slow_logged = 0;
+    }
+    if (++slow_logged > 10) {
+        return;
+    }
+    LOG_WARN("slow request %s: total %lu us = queue %lu + parse %lu + handle %lu + build %lu + send %lu",
+             m_real_file, (unsigned long) total, (unsigned long) queue, (unsigned long) parse,
+             (unsigned long) handle, (unsigned long) build, (unsigned long) send);
+}
+
 bool http_conn::add_response(const char *format, ...) {
     // 若写入内容超出m_write_buf大小则报错
     if (m_write_idx >= WRITE_BUFFER_SIZE) {
@@ -748,7 +1080,7 @@ bool http_conn::add_response(const char *format, ...) {
     // 清空可变参数列表
     va_end(arg_list);
 
-    LOG_INFO("request:%s", m_write_buf);
+    LOG_DEBUG("request:%s", m_write_buf);
 
     return true;
 }
@@ -760,7 +1092,12 @@ bool http_conn::add_status_line(int status, const char *title) {
 
 // 添加消息报头，具体的添加文本长度、连接状态和空行
 bool http_conn::add_headers(int content_len) {
-    return add_content_length(content_len) && add_linger() && add_blank_line();
+    return add_date() && add_content_length(content_len) && add_linger() && add_blank_line();
+}
+
+// 添加Date，使用每线程缓存，每秒最多格式化一次
+bool http_conn::add_date() {
+    return add_response("Date:%s\r\n", time_cache::http_date(NULL));
 }
 
 // 添加Content-Length，表示响应报文的长度
@@ -778,6 +1115,51 @@ bool http_conn::add_linger() {
     return add_response("Connection:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
 }
 
+bool http_conn::add_validators() {
+    if (!m_etag[0]) {
+        return true;
+    }
+    char last_modified[time_cache::HTTP_DATE_LEN + 1];
+    time_cache::http_date_of(m_file_stat.st_mtime, last_modified);
+    if (!add_response("ETag:%s\r\nLast-Modified:%s\r\n", m_etag, last_modified)) {
+        return false;
+    }
+    for (size_t i = 0; i < m_cache_rules.size(); ++i) {
+        if (strncmp(m_url, m_cache_rules[i].first.c_str(), m_cache_rules[i].first.size()) == 0) {
+            return add_response("Cache-Control:%s\r\n", m_cache_rules[i].second.c_str());
+        }
+    }
+    return true;
+}
+
+// If-None-Match优先，有它时忽略If-Modified-Since；列表中任一ETag相同即命中，按弱比较忽略W/前缀
+bool http_conn::not_modified() const {
+    if (m_if_none_match) {
+        const char *p = m_if_none_match;
+        size_t len = strlen(m_etag);
+        while (*p) {
+            p += strspn(p, " \t,");
+            if ('*' == *p) {
+                return true;
+            }
+            if (strncmp(p, "W/", 2) == 0) {
+                p += 2;
+            }
+            if (strncmp(p, m_etag, len) == 0 && (p[len] == '\0' || p[len] == ',' || p[len] == ' ' || p[len] == '\t')) {
+                return true;
+            }
+            p += strcspn(p, ",");
+        }
+        return false;
+    }
+    if (m_if_modified_since) {
+        // 晚于当前时间的日期无效，按RFC 9110忽略，否则客户端伪造的未来时间会让之后的修改一直返回304
+        time_t since = time_cache::parse_http_date(m_if_modified_since);
+        return since >= 0 && since <= time(NULL) && m_file_stat.st_mtime <= since;
+    }
+    return false;
+}
+
 // 添加空行
 bool http_conn::add_blank_line() {
     return add_response("%s", "\r\n");
@@ -828,12 +1210,28 @@ bool http_conn::process_write(HTTP_CODE ret) {
             }
             break;
         }
+        case NOT_MODIFIED: {
+            // 客户端缓存有效，304不带消息体
+            add_status_line(304, not_modified_304_title);
+            if (!add_date() || !add_validators() || !add_linger() || !add_blank_line()) {
+                return false;
+            }
+            break;
+        }
         case FILE_REQUEST: {
             // 文件存在，200
             add_status_line(200, ok_200_title);
+            // 写缓冲区放不下完整的响应头时关闭连接，不能发出截断的头部
+            if (!add_validators()) {
+                unmap();
+                return false;
+            }
             // 若请求资源存在
             if (m_file_stat.st_size != 0) {
-                add_headers(m_file_stat.st_size);
+                if (!add_headers(m_file_stat.st_size)) {
+                    unmap();
+                    return false;
+                }
                 // 第一个iovec指针指向响应报文缓冲区，长度指向m_write_idx
                 m_iv[0].iov_base = m_write_buf;  // 记录buffer的起始位置
                 m_iv[0].iov_len = m_write_idx;  // 记录buffer的size
@@ -864,9 +1262,37 @@ bool http_conn::process_write(HTTP_CODE ret) {
     return true;
 }
 
+// 不解析请求，直接生成错误响应，发送后关闭连接
+void http_conn::reject(int status, const char *title, const char *form) {
+    m_linger = false;
+    m_write_idx = 0;
+    add_status_line(status, title);
+    add_response("Retry-After:%d\r\n", RETRY_AFTER);
+    add_headers(strlen(form));
+    add_content(form);
+    m_iv[0].iov_base = m_write_buf;
+    m_iv[0].iov_len = m_write_idx;
+    m_iv_count = 1;
+    bytes_to_send = m_write_idx;
+    m_stage.built = metrics::now_ns();
+    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+}
+
+void http_conn::reject_overload() {
+    reject(503, error_503_title, error_503_form);
+}
+
+void http_conn::reject_rate_limited() {
+    reject(429, error_429_title, error_429_form);
+}
+
 void http_conn::process() {
+    m_stage.dequeue = metrics::now_ns();
     // process_read是干嘛的？
     HTTP_CODE read_ret = process_read();
+    m_stage.handled = metrics::now_ns();
+    metrics::inc(M_REQUESTS + read_ret);
+    metrics::inc_cpu();
 
     // NO_REQUEST，表示请求不完整，需要继续接受请求数据
     if (read_ret == NO_REQUEST) {
@@ -875,11 +1301,18 @@ void http_conn::process() {
         return;
     }
 
+    // 排空期间回复Connection: close，发送完毕后关闭长连接
+    if (m_draining.load(memory_order_relaxed)) {
+        m_linger = false;
+    }
+
     // 调用process_write完成报文响应
     bool write_ret = process_write(read_ret);
     if (!write_ret) {
         close_conn();
     }
+    // 注册写事件之后主线程可能立即开始发送，先记录时间
+    m_stage.built = metrics::now_ns();
     // 注册并监听写事件
     modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
 }
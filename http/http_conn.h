@@ -8,6 +8,7 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <assert.h>
 #include <sys/stat.h>
@@ -21,11 +22,18 @@
 #include <sys/wait.h>
 #include <sys/uio.h>
 #include <map>
+#include <vector>
+#include <atomic>
 
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
+#include "../CGImysql/user_table.h"
+#include "../CGImysql/user_snapshot.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
+#include "../log/time_cache.h"
+#include "../metrics/metrics.h"
+#include "../ratelimit/ip_limit.h"
 
 class http_conn {
 public:
@@ -62,7 +70,8 @@ public:
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
         INTERNAL_ERROR,
-        CLOSED_CONNECTION
+        CLOSED_CONNECTION,
+        NOT_MODIFIED        // 条件请求命中，回复304
     };
     // 从状态机的状态
     enum LINE_STATUS {
@@ -85,6 +94,18 @@ public:
 
     void process();
 
+    // 过载时代替process，直接回复503和Retry-After
+    void reject_overload();
+
+    // 超过单个IP的请求速率时代替process，直接回复429和Retry-After
+    void reject_rate_limited();
+
+    // 503、429响应建议客户端重试的等待秒数
+    static const int RETRY_AFTER = 1;
+
+    // 解析Cache-Control规则，格式为"路径前缀=取值;..."，按最长前缀匹配，格式错误返回false
+    static bool set_cache_rules(const string &spec);
+
     // 读取浏览器端发来的全部数据
     bool read_once();
 
@@ -96,11 +117,24 @@ public:
     }
 
     // 同步线程初始化数据库读取表
-    void initmysql_result(connection_pool *connPool);
+    // snapshot_path为用户表快照路径，NULL表示不使用快照
+    void initmysql_result(connection_pool *connPool, const char *snapshot_path, int close_log);
+
+    // 等待后台写快照的线程结束，进程退出前调用
+    static void wait_snapshot();
 
     int timer_flag;
     int improv;
 
+    // 读到请求数据时调用，记录请求开始时间，同一请求分多次到达时只记录第一次
+    void stage_begin() {
+        if (0 == m_stage.begin) {
+            m_stage.begin = metrics::now_ns();
+        }
+    }
+
+    // 组件微基准直接驱动解析与响应生成的私有方法
+    friend class http_conn_bench;
 
 private:
     void init();
@@ -123,6 +157,18 @@ private:
     // 生成响应报文
     HTTP_CODE do_request();
 
+    // 访问数据库的处理函数才获取连接，静态请求完全不经过连接池
+    MYSQL *acquire_mysql();
+
+    void release_mysql(MYSQL *con);
+
+    // 多进程模式下按用户名在数据库中查找密码：1找到，0不存在，-1数据库错误
+    int query_passwd(MYSQL *con, const char *name, string &passwd);
+
+    // 多进程模式下注册：用MySQL命名锁串行化各工作进程的查重和写入
+    // 0写入成功，1用户名已存在，-1数据库错误(已记录日志)
+    int insert_unique(MYSQL *con, const char *name, const char *sql_insert);
+
     // m_start_line是已经解析的字符
     // get_line用于将指针向后偏移，指向未处理的字符
     char *get_line() { return m_read_buf + m_start_line; };
@@ -132,6 +178,12 @@ private:
 
     void unmap();
 
+    // 不解析请求，直接生成带Retry-After的错误响应，发送后关闭连接
+    void reject(int status, const char *title, const char *form);
+
+    // 响应发送完毕，记录各阶段耗时，超过慢请求阈值时写日志
+    void stage_finish();
+
     // 根据响应报文格式，生成对应8个部分，以下几个add函数均由do_request调用
     bool add_response(const char *format, ...);
 
@@ -147,11 +199,28 @@ private:
 
     bool add_linger();
 
+    bool add_date();
+
     bool add_blank_line();
 
+    // 静态文件的ETag、Last-Modified和按路径配置的Cache-Control
+    bool add_validators();
+
+    // If-None-Match或If-Modified-Since表明客户端缓存仍然有效
+    bool not_modified() const;
+
 public:
     static int m_epollfd;
-    static int m_user_count;
+    // 主线程建立连接时加一，reactor模式下工作线程关闭连接时减一
+    static atomic<int> m_user_count;
+    static connection_pool *m_connPool;
+    static int m_sql_mode;  // 0: 每次从连接池借用, 1: 工作线程独占连接
+    static bool m_prefork;  // 多进程模式：用户表不在工作进程间共享，本地找不到时回查数据库
+    static int m_slow_ms;   // 慢请求阈值(ms)，超过时记录各阶段耗时，0为不记录
+    static int m_cork;      // 发送响应头和文件时是否加TCP_CORK
+    static atomic<bool> m_draining;  // 热重启后旧进程排空连接，之后的响应都关闭连接
+    // Cache-Control规则，按前缀长度从长到短排列，启动时设置后只读
+    static vector<pair<string, string> > m_cache_rules;
     MYSQL *mysql;
     int m_state;  // 读为0, 写为1
 
@@ -183,6 +252,9 @@ private:
     char *m_url;
     char *m_version;
     char *m_host;
+    char *m_if_none_match;      // 请求头If-None-Match
+    char *m_if_modified_since;  // 请求头If-Modified-Since
+    char m_etag[48];            // 由inode、修改时间、大小生成，GET静态文件时设置
     long m_content_length;
     bool m_linger;
 
@@ -200,6 +272,20 @@ private:
     int m_TRIGMode;
     int m_close_log;
 
+    // 请求经过各阶段的时间点(ns)，0表示未经过
+    // begin: 主线程读到数据(proactor)或投递读事件(reactor)
+    // dequeue: 工作线程开始处理；parsed: 解析完成进入do_request；handled: do_request返回
+    // built: 响应报文生成完毕，之后到write发送完毕为发送阶段
+    struct stage_times {
+        uint64_t begin;
+        uint64_t dequeue;
+        uint64_t parsed;
+        uint64_t handled;
+        uint64_t built;
+    };
+    stage_times m_stage;
+    bool m_corked;          // 当前响应是否已加TCP_CORK
+
     char sql_user[100];
     char sql_passwd[100];
     char sql_name[100];
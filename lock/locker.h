@@ -2,6 +2,8 @@
 #define LOCKER_H
 
 #include <exception>
+#include <errno.h>
+#include <time.h>
 #include <pthread.h>
 #include <semaphore.h>
 
@@ -27,6 +29,27 @@ public:
         return sem_wait(&m_sem) == 0;
     }
 
+    // 最多等待ms毫秒，超时返回false
+    bool timewait(int ms) {
+        struct timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        t.tv_sec += ms / 1000;
+        t.tv_nsec += (ms % 1000) * 1000000L;
+        if (t.tv_nsec >= 1000000000L) {
+            t.tv_sec++;
+            t.tv_nsec -= 1000000000L;
+        }
+        int ret;
+        while ((ret = sem_timedwait(&m_sem, &t)) != 0 && errno == EINTR) {
+        }
+        return ret == 0;
+    }
+
+    // 不等待，信号量为0时直接返回false
+    bool trywait() {
+        return sem_trywait(&m_sem) == 0;
+    }
+
     bool post() {
         return sem_post(&m_sem) == 0;
     }
@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <vector>
+#include <utility>
 #include "../lock/locker.h"
 
 using namespace std;
@@ -30,6 +32,7 @@ public:
         m_size = 0;
         m_front = -1;
         m_back = -1;
+        m_waiters = 0;
     }
 
     void clear() {
@@ -115,16 +118,14 @@ public:
         return tmp;
     }
 
-    // 往队列添加元素，需要将所有使用队列的线程先唤醒
+    // 往队列添加元素
     // 当有元素push进队列,相当于生产者生产了一个元素
-    // 若当前没有线程等待条件变量,则唤醒无意义
+    // 若当前没有线程等待条件变量,则唤醒无意义；一个元素也只需要唤醒一个消费者
     bool push(const T &item) {
         // 先上锁
         m_mutex.lock();
         if (m_size >= m_max_size) {
-            // 若当前可用个数大于等于最大个数
-            // 则直接广播唤醒所有元素并解锁，返回false
-            m_cond.broadcast();
+            // 队列满时不可能有消费者在等待，直接返回false
             m_mutex.unlock();
             return false;
         }
@@ -134,8 +135,24 @@ public:
         m_array[m_back] = item;
         m_size++;
 
-        // 唤醒元素
-        m_cond.broadcast();
+        notify();
+        m_mutex.unlock();
+        return true;
+    }
+
+    // 移动版本，队列满返回false时item保持不变，调用方仍可使用
+    bool push(T &&item) {
+        m_mutex.lock();
+        if (m_size >= m_max_size) {
+            m_mutex.unlock();
+            return false;
+        }
+
+        m_back = (m_back + 1) % m_max_size;
+        m_array[m_back] = std::move(item);
+        m_size++;
+
+        notify();
         m_mutex.unlock();
         return true;
     }
@@ -148,7 +165,10 @@ public:
         while (m_size <= 0) {
             // 资源不足的情况
             // 当重新抢到互斥锁，m_cond.wait会返回0
-            if (!m_cond.wait(m_mutex.get())) {
+            ++m_waiters;
+            bool ok = m_cond.wait(m_mutex.get());
+            --m_waiters;
+            if (!ok) {
                 // 表示发生互斥的情况
                 // 解锁
                 m_mutex.unlock();
@@ -159,45 +179,89 @@ public:
         // 当有足够资源的时候
         // 取出队列首的元素，使用循环数组模拟队列
         m_front = (m_front + 1) % m_max_size;
-        item = m_array[m_front];
+        item = std::move(m_array[m_front]);
         m_size--;
         m_mutex.unlock();
         return true;
     }
 
-    // 增加了超时处理（项目中没有使用到）
+    // 增加了超时处理，异步日志线程用它按刷新间隔醒来
     // 取出队列首的元素，这里需要理解一下，使用循环数组模拟的队列
     // 其他逻辑不变
     bool pop(T &item, int ms_timeout) {
-        struct timespec t = {0, 0};
-        struct timeval now = {0, 0};
-        gettimeofday(&now, NULL);
         m_mutex.lock();
-        if (m_size <= 0) {
-            t.tv_sec = now.tv_sec + ms_timeout / 1000;
-            t.tv_nsec = (ms_timeout % 1000) * 1000;
-            if (!m_cond.timewait(m_mutex.get(), t)) {
-                m_mutex.unlock();
-                return false;
-            }
-        }
-
-        if (m_size <= 0) {
+        if (!wait_nonempty(ms_timeout)) {
             m_mutex.unlock();
             return false;
         }
 
         m_front = (m_front + 1) % m_max_size;
-        item = m_array[m_front];
+        item = std::move(m_array[m_front]);
         m_size--;
         m_mutex.unlock();
         return true;
     }
 
+    // 批量取出：最多等待ms_timeout毫秒(0为不等待)，把当前所有元素移动追加到out中，返回取出的个数
+    // 一次加锁取走全部积压，消费者在锁外逐个处理
+    int pop_all(std::vector<T> &out, int ms_timeout) {
+        m_mutex.lock();
+        if (!wait_nonempty(ms_timeout)) {
+            m_mutex.unlock();
+            return 0;
+        }
+
+        int n = m_size;
+        for (int i = 0; i < n; ++i) {
+            m_front = (m_front + 1) % m_max_size;
+            out.push_back(std::move(m_array[m_front]));
+        }
+        m_size = 0;
+        m_mutex.unlock();
+        return n;
+    }
+
 private:
+    // 有消费者在等待时才唤醒，且只唤醒一个，调用方需持有m_mutex
+    void notify() {
+        if (m_waiters > 0) {
+            m_cond.signal();
+        }
+    }
+
+    // 队列为空时最多等待ms_timeout毫秒，返回是否有元素，调用方需持有m_mutex
+    bool wait_nonempty(int ms_timeout) {
+        if (m_size > 0) {
+            return true;
+        }
+        if (ms_timeout <= 0) {
+            return false;
+        }
+        struct timespec t = {0, 0};
+        struct timeval now = {0, 0};
+        gettimeofday(&now, NULL);
+        t.tv_sec = now.tv_sec + ms_timeout / 1000;
+        t.tv_nsec = now.tv_usec * 1000 + (ms_timeout % 1000) * 1000000L;
+        if (t.tv_nsec >= 1000000000L) {
+            t.tv_sec++;
+            t.tv_nsec -= 1000000000L;
+        }
+        // 虚假唤醒或被其他消费者抢先时继续等到超时
+        while (m_size <= 0) {
+            ++m_waiters;
+            bool ok = m_cond.timewait(m_mutex.get(), t);
+            --m_waiters;
+            if (!ok) {
+                break;
+            }
+        }
+        return m_size > 0;
+    }
+
     // 创建互斥锁和同步变量
     locker m_mutex;
     cond m_cond;
+    int m_waiters;  // 正在等待条件变量的消费者数
 
     T *m_array;
     int m_size;
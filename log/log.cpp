@@ -2,43 +2,156 @@
 #include <time.h>
 #include <sys/time.h>
 #include <stdarg.h>
+#include <unistd.h>
+#include <sched.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
 #include "log.h"
+#include "log_format.h"
+#include "time_cache.h"
 #include <pthread.h>
 
 using namespace std;
 
+extern char **environ;
+
+// 默认只输出info及以上等级
+atomic<int> Log::s_level(1);
+
+// 环形缓冲区模式下后台线程每批次最多写出的字节数
+static const size_t BATCH_SIZE = 1 << 20;
+
+// 环形缓冲区模式下每个线程私有的格式化缓冲区与环形缓冲区
+static __thread char *t_buf = NULL;
+static __thread log_ring *t_ring = NULL;
+
+// 毫秒级单调时钟，粗粒度时钟走vDSO，开销很小
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// 次日零点，用于不调用localtime判断跨天
+static time_t next_midnight(const struct tm &my_tm) {
+    struct tm t = my_tm;
+    t.tm_hour = 0;
+    t.tm_min = 0;
+    t.tm_sec = 0;
+    t.tm_mday += 1;
+    t.tm_isdst = -1;
+    return mktime(&t);
+}
+
 Log::Log() {
     m_count = 0;
     m_is_async = false;
+    m_log_queue = NULL;
+    m_fp = NULL;
+    m_ring_size = 0;
+    m_ring_num.store(0);
+    for (int i = 0; i < MAX_RINGS; ++i) {
+        m_rings[i].store(NULL);
+    }
+    m_stop = false;
+    m_has_thread = false;
+
+    m_flush_bytes = 64 * 1024;
+    m_flush_interval = 1000;
+    m_flush_on_error = true;
+    m_unflushed = 0;
+    m_last_flush = 0;
+    m_urgent.store(false);
+
+    m_binary = false;
+    m_day_end = 0;
+
+    m_split_bytes = 0;
+    m_compress = false;
+    m_file_bytes = 0;
+    m_file_seq = 0;
+    m_cur_name[0] = '\0';
+    m_rotating = false;
+    m_has_rotator = false;
 }
 
 Log::~Log() {
+    // 异步模式下等待后台线程写完剩余日志
+    if (m_has_thread) {
+        m_stop = true;
+        pthread_join(m_tid, NULL);
+    }
+    if (m_has_rotator) {
+        m_stop = true;
+        m_rotate_sem.post();
+        pthread_join(m_rotator, NULL);
+    }
+    // 退出时总是刷新
     if (m_fp != NULL) {
+        fflush(m_fp);
         fclose(m_fp);
     }
 }
 
+void Log::set_flush_policy(int flush_bytes, int flush_interval, bool flush_on_error) {
+    m_mutex.lock();
+    m_flush_bytes = flush_bytes;
+    m_flush_interval = flush_interval;
+    m_flush_on_error = flush_on_error;
+    m_mutex.unlock();
+}
+
+void Log::set_rotate_policy(long long split_bytes, bool compress) {
+    m_mutex.lock();
+    m_split_bytes = split_bytes;
+    m_compress = compress;
+    m_mutex.unlock();
+}
+
+void Log::set_level(int level) {
+    if (level < 0) {
+        level = 0;
+    } else if (level > 3) {
+        level = 3;
+    }
+    s_level.store(level, memory_order_relaxed);
+}
+
+bool Log::flush_due() {
+    return m_unflushed > 0 && ((long long) m_unflushed >= m_flush_bytes || now_ms() - m_last_flush >= m_flush_interval);
+}
+
+void Log::flush_locked() {
+    if (m_fp) {
+        fflush(m_fp);
+    }
+    m_unflushed = 0;
+    m_last_flush = now_ms();
+}
+
 // 异步需要设置阻塞队列的长度，同步不需要设置
 // 写入方式通过初始化时是否设置队列大小（表示在队列中可以放几条数据）来判断，若队列大小为0，则为同步，否则为异步
 // 参数有：日志文件、日志缓冲区大小、最大行数以及最长日志条队列
-bool Log::init(const char *file_name, int close_log, int log_buf_size, int split_lines, int max_queue_size) {
-    // 如果设置了max_queue_size,则设置为异步
-    if (max_queue_size >= 1) {
+bool Log::init(const char *file_name, int close_log, int log_buf_size, int split_lines, int max_queue_size,
+               int ring_size, bool binary) {
+    // 如果设置了ring_size，则每个线程写自己的环形缓冲区，由后台线程统一写文件
+    // 后台线程在日志文件打开后再创建
+    if (ring_size > 0) {
+        m_is_async = true;
+        m_ring_size = ring_size;
+    } else if (max_queue_size >= 1) {
+        // 如果设置了max_queue_size,则设置为异步
         // 表示异步处理
         m_is_async = true;
 
         // 创建并设置阻塞队列长度
         m_log_queue = new block_queue<string>(max_queue_size);
 
-        // 创建一个子线程完成异步操作
-        pthread_t tid;
-
-        // 第三个参数为：以函数指针的方式指明新建线程需要执行的函数
-        // flush_log_thread为回调函数,这里表示创建线程异步写日志
-        pthread_create(&tid, NULL, flush_log_thread, NULL);
     }
 
     m_close_log = close_log;  // 这是？
+    m_binary = binary;
     // 输出内容的长度
     m_log_buf_size = log_buf_size;
     m_buf = new char[m_log_buf_size];
@@ -54,41 +167,74 @@ bool Log::init(const char *file_name, int close_log, int log_buf_size, int split
 
     // 从后往前找到第一个/的位置
     const char *p = strrchr(file_name, '/');
-    char log_full_name[256] = {0};
 
     // 相当于自定义日志名
     // 若输入的文件名没有/，则直接将时间+文件名作为日志名
     if (p == NULL) {
-        // snprintf：格式化输出字符串log_full_name，最大长度为255.超过会被截断，格式化格式如后所示
-        snprintf(log_full_name, 255, "%d_%02d_%02d_%s", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
-                 file_name);
+        dir_name[0] = '\0';
+        strcpy(log_name, file_name);
     } else {
         // 将/的位置后移一个位置，然后复制到log_name中
         strcpy(log_name, p + 1);
         // p - file_name + 1是文件所在路径文件夹的长度，复制到dir_name中
         strncpy(dir_name, file_name, p - file_name + 1);
-        // dir_name 相当于 ./
-        snprintf(log_full_name, 255, "%s%d_%02d_%02d_%s", dir_name, my_tm.tm_year + 1900, my_tm.tm_mon + 1,
-                 my_tm.tm_mday, log_name);
     }
+    make_name(m_cur_name, my_tm, 0);
 
     m_today = my_tm.tm_mday;
+    m_day_end = next_midnight(my_tm);
 
-    // 打开log_full_name
-    m_fp = fopen(log_full_name, "a");
+    // 打开日志文件
+    m_fp = fopen(m_cur_name, "a");
     if (m_fp == NULL) {
         return false;
     }
 
+    // 按刷新阈值设置文件流缓冲区，阈值以内不会被stdio提前写出
+    setvbuf(m_fp, NULL, _IOFBF, m_flush_bytes);
+    m_last_flush = now_ms();
+
+    // 二进制日志：追加写入时以会话头与之前进程写入的内容分隔
+    if (m_binary) {
+        write_bin_header(m_fp);
+    }
+
+    // 切分在后台线程完成，写日志的线程不会执行fopen/fclose
+    m_has_rotator = pthread_create(&m_rotator, NULL, rotate_thread, NULL) == 0;
+
+    if (m_is_async) {
+        // 创建一个子线程完成异步操作
+        // 第三个参数为：以函数指针的方式指明新建线程需要执行的函数
+        // flush_log_thread为回调函数,这里表示创建线程异步写日志
+        m_has_thread = pthread_create(&m_tid, NULL, flush_log_thread, NULL) == 0;
+    }
+
     return true;
 }
 
 void Log::write_log(int level, const char *format, ...) {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, NULL);
-    time_t t = now.tv_sec;
-    struct tm *sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
+    va_list valst;
+    va_start(valst, format);
+    vwrite_log(level, format, valst);
+    va_end(valst);
+}
+
+void Log::write_log(int level, log_site *site, const char *format, ...) {
+    va_list valst;
+    va_start(valst, format);
+    if (m_binary) {
+        write_binary(level, site, format, valst);
+    } else {
+        vwrite_log(level, format, valst);
+    }
+    va_end(valst);
+}
+
+void Log::vwrite_log(int level, const char *format, va_list valst) {
+    // 每线程缓存，同一分钟内不再调用localtime
+    struct tm my_tm;
+    char prefix[48];
+    int n = time_cache::log_time(prefix, &my_tm);
     char s[16] = {0};
     // 日志分级
     switch (level) {
@@ -109,62 +255,52 @@ void Log::write_log(int level, const char *format, ...) {
             break;
     }
 
+    // 写入内容格式：时间 + 等级 + 内容
+    n += snprintf(prefix + n, sizeof(prefix) - n, " %s ", s);
+
+    // 环形缓冲区模式：不加锁，行数统计与切分由后台线程完成
+    if (m_ring_size > 0) {
+        write_ring(prefix, n, level, format, valst);
+        return;
+    }
+
     // 写入一个log，对m_count++, m_split_lines最大行数
     m_mutex.lock();
     // 更新现有行数
     m_count++;
 
-    // 日志不是今天 或 写入的日志行数是最大行的倍数(即超出最大行限制)
-    // m_split_lines 为最大行数
-    if (m_today != my_tm.tm_mday || m_count % m_split_lines == 0) { // everyday log
-        char new_log[256] = {0};
-        fflush(m_fp);
-        fclose(m_fp);
-        char tail[16] = {0};
-
-        // 格式化日志名中的时间部分
-        snprintf(tail, 16, "%d_%02d_%02d_", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday);
-
-        // 如果是时间不是今天，则创建今天的日志，更新m_today和m_count
-        if (m_today != my_tm.tm_mday) {
-            snprintf(new_log, 255, "%s%s%s", dir_name, tail, log_name);
-            m_today = my_tm.tm_mday;
-            m_count = 0;
-        } else {
-            // 超过了最大行，在之前的日志名基础上加后缀, m_count/m_split_lines
-            snprintf(new_log, 255, "%s%s%s.%lld", dir_name, tail, log_name, m_count / m_split_lines);
-        }
-        m_fp = fopen(new_log, "a");
-    }
+    // 日志不是今天、行数或大小超出限制时通知后台切分
+    check_rotate(m_today != my_tm.tm_mday);
 
     m_mutex.unlock();
 
-    va_list valst;
-    // 将传入的format参数赋值给valst，便于格式化输出
-    va_start(valst, format);
-
     string log_str;
     m_mutex.lock();
 
-    // 写入内容格式：时间 + 内容
-    // 时间格式化，snprintf成功返回写字符的总数，其中不包括结尾的null字符
-    int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ",
-                     my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
-                     my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
+    memcpy(m_buf, prefix, n);
 
     // 内容格式化，用于向字符串中打印数据、数据格式用户自定义，返回写入到字符数组str中的字符个数(不包含终止符)
     int m = vsnprintf(m_buf + n, m_log_buf_size - n - 1, format, valst);
+    // 内容被截断时vsnprintf返回的是完整长度
+    if (m > m_log_buf_size - n - 2) {
+        m = m_log_buf_size - n - 2;
+    }
     m_buf[n + m] = '\n';
     m_buf[n + m + 1] = '\0';
     log_str = m_buf;
 
     m_mutex.unlock();
 
+    bool urgent = 3 == level && m_flush_on_error;
+
     // 若m_is_async为true表示异步，默认为同步
     // 若异步,则将日志信息加入阻塞队列,同步则加锁向文件中写
-    if (m_is_async && !m_log_queue->full()) {
-        // 异步
-        m_log_queue->push(log_str);
+    // 入队失败时log_str不会被移走，退化为同步写
+    if (m_is_async && m_log_queue->push(std::move(log_str))) {
+        // 异步，入队之后再置位，后台线程看到标志时该行一定已经在队列中
+        if (urgent) {
+            m_urgent.store(true, memory_order_release);
+        }
     } else {
         // 同步
         /**
@@ -174,15 +310,473 @@ void Log::write_log(int level, const char *format, ...) {
          * **/
         m_mutex.lock();
         fputs(log_str.c_str(), m_fp);
+        m_unflushed += log_str.size();
+        m_file_bytes += log_str.size();
+        if (urgent || flush_due()) {
+            flush_locked();
+        }
         m_mutex.unlock();
     }
+}
+
+char *Log::thread_buf() {
+    if (!t_buf) {
+        t_buf = new char[m_log_buf_size];
+    }
+    return t_buf;
+}
 
-    va_end(valst);
+// 格式串记录：'F' + u32编号 + u16长度 + 内容，调用方需持有m_mutex
+static void put_format(FILE *fp, uint32_t id, const string &format) {
+    char head[7];
+    uint16_t len = (uint16_t) (format.size() > 0xffff ? 0xffff : format.size());
+    head[0] = LOG_BIN_FORMAT;
+    memcpy(head + 1, &id, 4);
+    memcpy(head + 5, &len, 2);
+    fwrite(head, 1, sizeof(head), fp);
+    fwrite(format.data(), 1, len, fp);
+}
+
+int Log::register_site(log_site *site, const char *format) {
+    m_mutex.lock();
+    // 多个线程同时首次执行同一调用点时只注册一次
+    int id = site->id.load(memory_order_relaxed);
+    if (id == 0) {
+        site->types = strdup(log_arg_types(format).c_str());
+        m_formats.push_back(format);
+        id = (int) m_formats.size();
+
+        // 格式串直接写入当前文件并刷新，注册只在每个调用点第一次执行时发生
+        // 使用它的日志项可能经队列或环形缓冲区稍后才写出，解码时先收集整个会话的格式串
+        if (m_fp) {
+            put_format(m_fp, id, m_formats.back());
+            fflush(m_fp);
+        }
+        // types先于编号发布
+        site->id.store(id, memory_order_release);
+    }
+    m_mutex.unlock();
+    return id;
+}
+
+void Log::write_bin_header(FILE *fp) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    char head[LOG_BIN_SESSION_SIZE];
+    uint32_t version = LOG_BIN_VERSION;
+    uint64_t start = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    head[0] = LOG_BIN_SESSION;
+    memcpy(head + 1, LOG_BIN_MAGIC, 4);
+    memcpy(head + 5, &version, 4);
+    memcpy(head + 9, &start, 8);
+    fwrite(head, 1, sizeof(head), fp);
+    // 切分后的新文件中，日志项仍可能引用之前注册的格式串
+    for (size_t i = 0; i < m_formats.size(); ++i) {
+        put_format(fp, i + 1, m_formats[i]);
+    }
+    fflush(fp);
 }
 
+// 热路径上没有localtime和格式化，只按参数类型序列拷贝原始字节
+void Log::write_binary(int level, log_site *site, const char *format, va_list valst) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    int id = site->id.load(memory_order_acquire);
+    if (id == 0) {
+        id = register_site(site, format);
+    }
+
+    char *buf = thread_buf();
+    size_t cap = m_log_buf_size;
+    size_t n = LOG_BIN_ENTRY_SIZE;
+    // 空间不足时截断参数，解码端对缺失的参数输出占位
+    for (const char *t = site->types; *t; ++t) {
+        if (*t == 's') {
+            const char *str = va_arg(valst, const char *);
+            if (!str) {
+                str = "(null)";
+            }
+            if (n + 2 > cap) {
+                break;
+            }
+            size_t len = strlen(str);
+            if (len > cap - n - 2) {
+                len = cap - n - 2;
+            }
+            uint16_t len16 = (uint16_t) (len > 0xffff ? 0xffff : len);
+            memcpy(buf + n, &len16, 2);
+            memcpy(buf + n + 2, str, len16);
+            n += 2 + len16;
+        } else if (*t == 'i') {
+            int32_t v = va_arg(valst, int);
+            if (n + 4 > cap) {
+                break;
+            }
+            memcpy(buf + n, &v, 4);
+            n += 4;
+        } else {
+            // 64位整数、浮点数和指针都按8字节记录，long double降为double
+            char v[8];
+            if (*t == 'l') {
+                int64_t x = va_arg(valst, long long);
+                memcpy(v, &x, 8);
+            } else if (*t == 'd') {
+                double x = va_arg(valst, double);
+                memcpy(v, &x, 8);
+            } else if (*t == 'D') {
+                double x = (double) va_arg(valst, long double);
+                memcpy(v, &x, 8);
+            } else {
+                uint64_t x = (uintptr_t) va_arg(valst, void *);
+                memcpy(v, &x, 8);
+            }
+            if (n + 8 > cap) {
+                break;
+            }
+            memcpy(buf + n, v, 8);
+            n += 8;
+        }
+    }
+
+    uint32_t fid = id;
+    uint64_t stamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    uint16_t args = (uint16_t) (n - LOG_BIN_ENTRY_SIZE);
+    buf[0] = LOG_BIN_ENTRY;
+    buf[1] = (char) level;
+    memcpy(buf + 2, &fid, 4);
+    memcpy(buf + 6, &stamp, 8);
+    memcpy(buf + 14, &args, 2);
+
+    bool urgent = 3 == level && m_flush_on_error;
+
+    // 环形缓冲区模式：与文本日志相同，不加锁
+    if (m_ring_size > 0) {
+        log_ring *ring = thread_ring();
+        if (!ring) {
+            write_batch(buf, n, 1);
+            return;
+        }
+        while (!ring->push(buf, n)) {
+            sched_yield();
+        }
+        if (urgent) {
+            m_urgent.store(true, memory_order_release);
+        }
+        return;
+    }
+
+    m_mutex.lock();
+    m_count++;
+    check_rotate(ts.tv_sec >= m_day_end);
+    if (m_is_async) {
+        m_mutex.unlock();
+        if (m_log_queue->push(string(buf, n))) {
+            if (urgent) {
+                m_urgent.store(true, memory_order_release);
+            }
+            return;
+        }
+        // 队列已满，退化为同步写
+        m_mutex.lock();
+    }
+    if (m_fp) {
+        fwrite(buf, 1, n, m_fp);
+    }
+    m_unflushed += n;
+    m_file_bytes += n;
+    if (urgent || flush_due()) {
+        flush_locked();
+    }
+    m_mutex.unlock();
+}
+
+
 void Log::flush(void) {
     m_mutex.lock();
     // 强制刷新写入流缓冲区
-    fflush(m_fp);
+    flush_locked();
+    m_mutex.unlock();
+}
+
+void *Log::async_write_log() {
+    // 每次加锁取走队列中的全部日志，写文件时不再占用队列锁
+    vector<string> batch;
+    while (true) {
+        // 先读停止标志，停止后把队列中剩余的日志写完再退出
+        bool stop = m_stop;
+        batch.clear();
+        // 最多等待一个刷新间隔，保证空闲时已写入的日志也能按时刷新
+        m_log_queue->pop_all(batch, m_flush_interval);
+        // 有ERROR日志：把置位之前入队的日志全部取出，写出后立即刷新
+        bool urgent = m_urgent.exchange(false, memory_order_acquire);
+        if (urgent) {
+            m_log_queue->pop_all(batch, 0);
+        }
+
+        m_mutex.lock();
+        for (size_t i = 0; i < batch.size(); ++i) {
+            fwrite(batch[i].data(), 1, batch[i].size(), m_fp);
+            m_unflushed += batch[i].size();
+            m_file_bytes += batch[i].size();
+        }
+        if (urgent || flush_due() || (stop && m_unflushed > 0)) {
+            flush_locked();
+        }
+        m_mutex.unlock();
+
+        if (batch.empty() && stop) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+void Log::make_name(char *buf, const struct tm &my_tm, int seq) {
+    // snprintf：格式化输出字符串buf，最大长度为255.超过会被截断
+    int n = snprintf(buf, 255, "%s%d_%02d_%02d_%s", dir_name, my_tm.tm_year + 1900, my_tm.tm_mon + 1,
+                     my_tm.tm_mday, log_name);
+    // 超过了最大行数或大小，在当天日志名基础上加序号后缀
+    if (seq > 0 && n < 255) {
+        snprintf(buf + n, 255 - n, ".%d", seq);
+    }
+}
+
+void Log::check_rotate(bool new_day) {
+    if (m_rotating || !m_has_rotator) {
+        return;
+    }
+    if (new_day || m_count >= m_split_lines || (m_split_bytes > 0 && m_file_bytes >= m_split_bytes)) {
+        m_rotating = true;
+        m_rotate_sem.post();
+    }
+}
+
+void *Log::rotate_thread(void *args) {
+    Log *log = Log::get_instance();
+    while (true) {
+        // 定时醒来回收已结束的gzip进程
+        bool got = log->m_rotate_sem.timewait(1000);
+        log->reap();
+        if (log->m_stop) {
+            break;
+        }
+        if (got) {
+            log->rotate();
+        }
+    }
+    return NULL;
+}
+
+// 切分期间其他线程照常写旧文件，旧文件可能略微超出限制
+void Log::rotate() {
+    time_t t = time(NULL);
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
+
+    m_mutex.lock();
+    bool new_day = t >= m_day_end;
+    int seq = new_day ? 0 : m_file_seq + 1;
+    m_mutex.unlock();
+
+    char new_log[256] = {0};
+    make_name(new_log, my_tm, seq);
+    FILE *fp = fopen(new_log, "a");
+    if (fp == NULL) {
+        LOG_ERROR("open log file %s failed: %s", new_log, strerror(errno));
+        // 稍后由下一条日志重新触发，避免每行都重试
+        sleep(1);
+        m_mutex.lock();
+        m_rotating = false;
+        m_mutex.unlock();
+        return;
+    }
+    setvbuf(fp, NULL, _IOFBF, m_flush_bytes);
+
+    // 持锁只交换文件指针
+    m_mutex.lock();
+    if (m_binary) {
+        write_bin_header(fp);
+    }
+    FILE *old = m_fp;
+    char old_name[256];
+    strcpy(old_name, m_cur_name);
+    m_fp = fp;
+    strcpy(m_cur_name, new_log);
+    if (new_day) {
+        m_today = my_tm.tm_mday;
+        m_day_end = next_midnight(my_tm);
+    }
+    m_file_seq = seq;
+    m_count = 0;
+    m_file_bytes = 0;
+    m_unflushed = 0;
+    m_last_flush = now_ms();
+    m_rotating = false;
+    m_mutex.unlock();
+
+    // 旧文件已没有写者，关闭时写出stdio缓冲区中剩余的内容
+    if (old) {
+        fclose(old);
+    }
+    if (m_compress) {
+        compress(old_name);
+    }
+}
+
+void Log::compress(const char *path) {
+    char *argv[] = {(char *) "gzip", (char *) "-f", (char *) path, NULL};
+    pid_t pid;
+    int ret = posix_spawnp(&pid, "gzip", NULL, NULL, argv, environ);
+    if (ret != 0) {
+        LOG_ERROR("spawn gzip for %s failed: %s", path, strerror(ret));
+        return;
+    }
+    // 不等待压缩完成，否则压缩期间无法进行下一次切分
+    m_gzip.push_back(pid);
+}
+
+void Log::reap() {
+    for (size_t i = 0; i < m_gzip.size();) {
+        int status;
+        pid_t ret = waitpid(m_gzip[i], &status, WNOHANG);
+        if (ret == 0) {
+            ++i;
+            continue;
+        }
+        m_gzip[i] = m_gzip.back();
+        m_gzip.pop_back();
+    }
+}
+
+int Log::queue_size() {
+    if (m_log_queue) {
+        return m_log_queue->size();
+    }
+    size_t total = 0;
+    int num = m_ring_size > 0 ? m_ring_num.load(memory_order_acquire) : 0;
+    if (num > MAX_RINGS) {
+        num = MAX_RINGS;
+    }
+    for (int i = 0; i < num; ++i) {
+        log_ring *ring = m_rings[i].load(memory_order_acquire);
+        if (ring) {
+            total += ring->pending();
+        }
+    }
+    return (int) total;
+}
+
+log_ring *Log::thread_ring() {
+    if (t_ring) {
+        return t_ring;
+    }
+    // 注册只在线程第一次写日志时发生，先占位再发布，后台线程遇到NULL会跳过
+    int idx = m_ring_num.fetch_add(1);
+    if (idx >= MAX_RINGS) {
+        return NULL;
+    }
+    thread_buf();
+    t_ring = new log_ring(m_ring_size);
+    m_rings[idx].store(t_ring, memory_order_release);
+    return t_ring;
+}
+
+void Log::write_ring(const char *prefix, int n, int level, const char *format, va_list valst) {
+    log_ring *ring = thread_ring();
+    // 超出MAX_RINGS的线程也使用私有缓冲区格式化
+    thread_buf();
+
+    // 格式化到线程私有缓冲区，不需要任何锁
+    memcpy(t_buf, prefix, n);
+    int m = vsnprintf(t_buf + n, m_log_buf_size - n - 1, format, valst);
+    if (m > m_log_buf_size - n - 2) {
+        m = m_log_buf_size - n - 2;
+    }
+    t_buf[n + m] = '\n';
+
+    if (!ring) {
+        // 线程数超过MAX_RINGS，退化为直接写文件
+        write_batch(t_buf, n + m + 1, 1);
+        return;
+    }
+
+    // 缓冲区满时让出CPU等待后台线程取走，不丢日志
+    while (!ring->push(t_buf, n + m + 1)) {
+        sched_yield();
+    }
+    // 写入之后再置位，后台线程看到标志时该行一定已经在缓冲区中
+    if (3 == level && m_flush_on_error) {
+        m_urgent.store(true, memory_order_release);
+    }
+}
+
+// 环形缓冲区模式下write即为刷新，刷新策略决定批次攒多大、多久写一次
+void Log::drain_rings() {
+    char *batch = new char[BATCH_SIZE];
+    size_t len = 0;
+    long long records = 0;
+    long long last_write = now_ms();
+    int idle = 0;
+    while (true) {
+        // 先读停止标志和ERROR标志再收集，保证置位之前写入的日志都能被取走
+        bool stop = m_stop;
+        bool urgent = m_urgent.exchange(false, memory_order_acquire);
+        size_t before = len;
+        int num = m_ring_num.load(memory_order_acquire);
+        if (num > MAX_RINGS) {
+            num = MAX_RINGS;
+        }
+        for (int i = 0; i < num && len < BATCH_SIZE; ++i) {
+            log_ring *ring = m_rings[i].load(memory_order_acquire);
+            if (ring) {
+                len += ring->pop(batch + len, BATCH_SIZE - len, &records);
+            }
+        }
+
+        long long now = now_ms();
+        if (len > 0 && (urgent || stop || len >= (size_t) m_flush_bytes
+                        || len + m_log_buf_size > BATCH_SIZE
+                        || now - last_write >= m_flush_interval)) {
+            write_batch(batch, len, records);
+            len = 0;
+            records = 0;
+            last_write = now;
+        }
+        if (len > before) {
+            idle = 0;
+            continue;
+        }
+        if (stop && len == 0) {
+            break;
+        }
+        // 没有新日志时逐步退避，写日志的线程不需要任何唤醒操作
+        usleep(idle < 100 ? 50 : 1000);
+        ++idle;
+    }
+    delete[] batch;
+}
+
+void Log::write_batch(const char *batch, size_t len, long long records) {
+    bool new_day = time(NULL) >= m_day_end;
+
+    m_mutex.lock();
+    m_count += records;
+    check_rotate(new_day);
+
+    // 直接写文件描述符，整批一次系统调用
+    int fd = m_fp ? fileno(m_fp) : -1;
+    size_t done = 0;
+    while (fd >= 0 && done < len) {
+        ssize_t ret = ::write(fd, batch + done, len - done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += ret;
+    }
+    m_file_bytes += done;
     m_mutex.unlock();
 }
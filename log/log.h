@@ -6,10 +6,27 @@
 #include <string>
 #include <stdarg.h>
 #include <pthread.h>
+#include <time.h>
+#include <atomic>
+#include <vector>
 #include "block_queue.h"
+#include "log_ring.h"
 
 using namespace std;
 
+// 编译期最低日志等级：0 debug, 1 info, 2 warn, 3 error
+// 低于该等级的LOG_*语句整体被编译器消除，例如 make CXXFLAGS=-DLOG_MIN_LEVEL=2
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// 日志调用点，每个LOG_*宏展开处一个静态实例
+// 二进制模式下首次执行时注册格式串并解析参数类型，之后只记录编号和原始参数
+struct log_site {
+    atomic<int> id;      // 格式串编号，0表示尚未注册
+    const char *types;   // 参数类型序列，见log_format.h
+};
+
 class Log {
 public:
     // C++11以后,使用局部变量懒汉不用加锁
@@ -18,43 +35,132 @@ public:
         return &instance;
     }
 
-    // 异步写日志公有方法，调用私有方法async_write_log
+    // 异步写日志公有方法，调用私有方法async_write_log或drain_rings
     static void *flush_log_thread(void *args) {
-        Log::get_instance()->async_write_log();
+        Log *log = Log::get_instance();
+        if (log->m_ring_size > 0) {
+            log->drain_rings();
+        } else {
+            log->async_write_log();
+        }
+        return NULL;
     }
 
     // 可选择的参数有日志文件、日志缓冲区大小、最大行数以及最长日志条队列
+    // ring_size大于0时使用每线程环形缓冲区的无锁异步模式，ring_size为每个线程缓冲区的字节数
+    // binary为true时写二进制日志，由log_decode离线还原为文本
     bool init(const char *file_name, int close_log, int log_buf_size = 8192, int split_lines = 5000000,
-              int max_queue_size = 0);
+              int max_queue_size = 0, int ring_size = 0, bool binary = false);
 
     // 将输出内容按照标准格式整理
     void write_log(int level, const char *format, ...);
 
+    // LOG_*宏调用的入口，二进制模式下不做任何格式化
+    void write_log(int level, log_site *site, const char *format, ...);
+
     // 强制刷新缓冲区
     void flush(void);
 
+    // 异步模式下等待写入的日志条数：阻塞队列的长度，或各线程环形缓冲区中尚未取出的记录数之和；同步模式为0
+    int queue_size();
+
+    // 后台写线程与切分线程，用于绑定CPU
+    void background_threads(vector<pthread_t> &tids) {
+        if (m_has_thread) {
+            tids.push_back(m_tid);
+        }
+        if (m_has_rotator) {
+            tids.push_back(m_rotator);
+        }
+    }
+
+    // 运行时日志等级阈值，低于阈值的日志在调用点直接跳过，参数不会被求值
+    static bool level_enabled(int level) {
+        return level >= s_level.load(memory_order_relaxed);
+    }
+
+    // 调整运行时阈值，超出范围时截断到[0, 3]
+    static void set_level(int level);
+
+    static int get_level() {
+        return s_level.load(memory_order_relaxed);
+    }
+
+    // 切分策略：按天和按行数之外，单个文件超过split_bytes字节时也切分(0为不限制)
+    // compress为true时由后台切分线程调用gzip压缩切分出的旧文件，需在init之前调用
+    void set_rotate_policy(long long split_bytes, bool compress);
+
+    // 刷新策略：累计未刷新字节数达到flush_bytes、距上次刷新超过flush_interval毫秒时刷新，
+    // flush_on_error为true时ERROR日志立即刷新，退出时总会刷新，同步与异步模式统一适用
+    void set_flush_policy(int flush_bytes, int flush_interval, bool flush_on_error);
+
 private:
     Log();
 
     virtual ~Log();
 
     // 异步写日志方法
-    void *async_write_log() {
-        string single_log;
-        // 从阻塞队列中取出一个日志string放入single_log中，并写入文件
-        while (m_log_queue->pop(single_log)) {
-            m_mutex.lock();
-            fputs(single_log.c_str(), m_fp);
-            m_mutex.unlock();
-        }
-    }
+    void *async_write_log();
+
+    // 文本格式化并写出
+    void vwrite_log(int level, const char *format, va_list valst);
+
+    // 二进制模式：记录格式串编号、原始时间戳和原始参数
+    void write_binary(int level, log_site *site, const char *format, va_list valst);
+
+    // 二进制模式：注册调用点的格式串，返回编号
+    int register_site(log_site *site, const char *format);
+
+    // 二进制模式：向fp写会话头和已注册的全部格式串，调用方需持有m_mutex
+    void write_bin_header(FILE *fp);
+
+    // 当前线程私有的格式化/编码缓冲区
+    char *thread_buf();
+
+    // 按刷新策略判断是否需要刷新，调用方需持有m_mutex
+    bool flush_due();
+
+    // 刷新文件流并重置计数，调用方需持有m_mutex
+    void flush_locked();
+
+    // 到达切分条件时通知后台切分线程，写日志的线程继续写当前文件，调用方需持有m_mutex
+    void check_rotate(bool new_day);
+
+    // 后台切分线程：在锁外打开新文件，持锁只交换文件指针，再在锁外关闭并按需压缩旧文件
+    static void *rotate_thread(void *args);
+
+    void rotate();
+
+    // 生成日志文件名，seq大于0时加后缀
+    void make_name(char *buf, const struct tm &my_tm, int seq);
+
+    // 后台压缩已切分的文件
+    void compress(const char *path);
+
+    // 回收已结束的压缩进程，只在切分线程中调用
+    void reap();
+
+    // 环形缓冲区模式：当前线程的缓冲区，首次调用时创建并注册，线程过多时返回NULL
+    log_ring *thread_ring();
+
+    // 环形缓冲区模式：prefix为已格式化的时间和等级，格式化到线程私有缓冲区后写入环形缓冲区，不加锁
+    // level为日志等级，ERROR时通知后台线程立即落盘
+    void write_ring(const char *prefix, int n, int level, const char *format, va_list valst);
+
+    // 环形缓冲区模式：后台线程轮询所有缓冲区，合并成大块后一次write
+    void drain_rings();
+
+    // 环形缓冲区模式：写出一批共records条日志，并在后台线程中完成切分检查
+    void write_batch(const char *batch, size_t len, long long records);
 
 private:
+    static atomic<int> s_level;  // 运行时日志等级阈值
+
     char dir_name[128]; // 路径名
     char log_name[128]; // log文件名
     int m_split_lines;  // 日志最大行数
     int m_log_buf_size; // 日志缓冲区大小
-    long long m_count;  // 日志行数记录
+    long long m_count;  // 当前文件的日志行数
     int m_today;        // 因为按天分类,记录当前时间是那一天
     FILE *m_fp;         // 打开log的文件指针
     char *m_buf;        // 要输出的内容
@@ -62,12 +168,45 @@ private:
     bool m_is_async;                  // 是否同步标志位
     locker m_mutex;  // 同步类
     int m_close_log; // 关闭日志
+
+    static const int MAX_RINGS = 256;     // 最多注册的线程数，超出的线程退化为加锁同步写
+    int m_ring_size;                      // 每线程环形缓冲区大小，0表示不使用
+    atomic<log_ring *> m_rings[MAX_RINGS];
+    atomic<int> m_ring_num;
+    volatile bool m_stop;                 // 通知后台线程写完剩余日志后退出
+    bool m_has_thread;
+    pthread_t m_tid;                      // 后台写线程
+
+    int m_flush_bytes;            // 未刷新字节数阈值
+    int m_flush_interval;         // 刷新间隔(ms)
+    bool m_flush_on_error;        // ERROR日志是否立即刷新
+    size_t m_unflushed;           // 上次刷新后写入的字节数
+    long long m_last_flush;       // 上次刷新的时间(ms)
+    atomic<bool> m_urgent;        // 异步模式下有ERROR日志入队，后台线程需尽快写出并刷新
+
+    bool m_binary;                // 是否写二进制日志
+    vector<string> m_formats;     // 已注册的格式串，下标为编号-1，切分后在新文件开头重新写出
+    time_t m_day_end;             // 今天结束的时刻，不调用localtime也能判断跨天
+
+    long long m_split_bytes;      // 单个文件的最大字节数，0为不限制
+    bool m_compress;              // 是否压缩切分出的旧文件
+    long long m_file_bytes;       // 当前文件已写入的字节数
+    int m_file_seq;               // 当天的文件序号，文件名后缀
+    char m_cur_name[256];         // 当前文件名
+    bool m_rotating;              // 已通知切分线程，尚未完成
+    sem m_rotate_sem;             // 唤醒切分线程
+    bool m_has_rotator;
+    pthread_t m_rotator;          // 后台切分线程
+    vector<pid_t> m_gzip;         // 尚未结束的压缩进程
 };
 
 // 这四个宏定义在其他文件中使用，主要用于不同类型的日志输出
-#define LOG_DEBUG(format, ...) if(0 == m_close_log) {Log::get_instance()->write_log(0, format, ##__VA_ARGS__); Log::get_instance()->flush();}
-#define LOG_INFO(format, ...) if(0 == m_close_log) {Log::get_instance()->write_log(1, format, ##__VA_ARGS__); Log::get_instance()->flush();}
-#define LOG_WARN(format, ...) if(0 == m_close_log) {Log::get_instance()->write_log(2, format, ##__VA_ARGS__); Log::get_instance()->flush();}
-#define LOG_ERROR(format, ...) if(0 == m_close_log) {Log::get_instance()->write_log(3, format, ##__VA_ARGS__); Log::get_instance()->flush();}
+// 不再每条日志都fflush，由刷新策略统一决定
+// 每个调用点带一个静态log_site，format需为字符串字面量
+// 先比较编译期常量，再读取一次运行时阈值，被过滤的日志只有一次可预测的分支
+#define LOG_DEBUG(format, ...) if(LOG_MIN_LEVEL <= 0 && 0 == m_close_log && Log::level_enabled(0)) {static log_site site_; Log::get_instance()->write_log(0, &site_, format, ##__VA_ARGS__);}
+#define LOG_INFO(format, ...) if(LOG_MIN_LEVEL <= 1 && 0 == m_close_log && Log::level_enabled(1)) {static log_site site_; Log::get_instance()->write_log(1, &site_, format, ##__VA_ARGS__);}
+#define LOG_WARN(format, ...) if(LOG_MIN_LEVEL <= 2 && 0 == m_close_log && Log::level_enabled(2)) {static log_site site_; Log::get_instance()->write_log(2, &site_, format, ##__VA_ARGS__);}
+#define LOG_ERROR(format, ...) if(LOG_MIN_LEVEL <= 3 && 0 == m_close_log && Log::level_enabled(3)) {static log_site site_; Log::get_instance()->write_log(3, &site_, format, ##__VA_ARGS__);}
 
 #endif
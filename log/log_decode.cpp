@@ -0,0 +1,240 @@
+/*************************************************************
+*二进制日志离线解码工具
+*用法：./log_decode ServerLog.bin文件 [...]，文本输出到标准输出
+*输出格式与文本日志一致：时间 + 等级 + 内容
+**************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "log_format.h"
+
+using namespace std;
+
+static const char *LEVELS[] = {"[debug]:", "[info]:", "[warn]:", "[erro]:"};
+
+// 按转换说明和已取出的'*'参数格式化一个值
+template<class T>
+static void render(string &out, const string &spec, int stars, const int *star_args, T v) {
+    char buf[512];
+    int n;
+    if (stars == 0) {
+        n = snprintf(buf, sizeof(buf), spec.c_str(), v);
+    } else if (stars == 1) {
+        n = snprintf(buf, sizeof(buf), spec.c_str(), star_args[0], v);
+    } else {
+        n = snprintf(buf, sizeof(buf), spec.c_str(), star_args[0], star_args[1], v);
+    }
+    if (n > 0) {
+        out.append(buf, n < (int) sizeof(buf) ? n : sizeof(buf) - 1);
+    }
+}
+
+// 参数读取器，越界时返回false，对应位置输出占位
+struct arg_reader {
+    const char *p;
+    const char *end;
+
+    bool read(void *dst, size_t len) {
+        if ((size_t) (end - p) < len) {
+            return false;
+        }
+        memcpy(dst, p, len);
+        p += len;
+        return true;
+    }
+};
+
+// 依照格式串把原始参数还原为文本
+static string render_entry(const string &format, arg_reader &args) {
+    string out;
+    const char *f = format.c_str();
+    while (*f) {
+        const char *pct = strchr(f, '%');
+        if (!pct) {
+            out.append(f);
+            break;
+        }
+        out.append(f, pct - f);
+        log_spec spec;
+        f = log_parse_spec(pct, &spec);
+        if (spec.type == '%') {
+            out.push_back('%');
+            continue;
+        }
+        if (spec.type == 0) {
+            // 写入端从这里开始不再记录参数，剩余部分原样输出
+            out.append(spec.begin);
+            break;
+        }
+
+        int star_args[2] = {0, 0};
+        bool ok = true;
+        for (int i = 0; i < spec.stars && ok; ++i) {
+            int32_t v;
+            ok = args.read(&v, 4);
+            star_args[i] = v;
+        }
+        // long double在写入端已降为double，去掉长度修饰符L
+        string s;
+        for (const char *c = spec.begin; c < spec.end; ++c) {
+            if (*c != 'L') {
+                s.push_back(*c);
+            }
+        }
+        if (spec.type == 's') {
+            uint16_t len;
+            if (ok && args.read(&len, 2) && (size_t) (args.end - args.p) >= len) {
+                string str(args.p, len);
+                args.p += len;
+                render(out, s, spec.stars, star_args, str.c_str());
+                continue;
+            }
+        } else if (spec.type == 'i') {
+            int32_t v;
+            if (ok && args.read(&v, 4)) {
+                render(out, s, spec.stars, star_args, (int) v);
+                continue;
+            }
+        } else if (spec.type == 'l') {
+            int64_t v;
+            if (ok && args.read(&v, 8)) {
+                render(out, s, spec.stars, star_args, (long long) v);
+                continue;
+            }
+        } else if (spec.type == 'd' || spec.type == 'D') {
+            double v;
+            if (ok && args.read(&v, 8)) {
+                render(out, s, spec.stars, star_args, v);
+                continue;
+            }
+        } else if (spec.type == 'p') {
+            uint64_t v;
+            if (ok && args.read(&v, 8)) {
+                render(out, s, spec.stars, star_args, (void *) (uintptr_t) v);
+                continue;
+            }
+        }
+        // 参数被截断
+        out.append("<?>");
+        args.p = args.end;
+    }
+    return out;
+}
+
+// 遍历一个文件中的所有记录，pass为0时收集格式串，为1时输出日志项
+// 格式串按(会话序号, 编号)区分：同一文件可能被多个进程先后追加写入
+static bool walk(const vector<char> &data, int pass, map<pair<int, uint32_t>, string> &formats, FILE *out) {
+    const char *p = data.empty() ? NULL : &data[0];
+    const char *end = p + data.size();
+    int session = -1;
+    while (p < end) {
+        char type = *p;
+        if (type == LOG_BIN_SESSION) {
+            if ((size_t) (end - p) < LOG_BIN_SESSION_SIZE || memcmp(p + 1, LOG_BIN_MAGIC, 4) != 0) {
+                break;
+            }
+            uint32_t version;
+            memcpy(&version, p + 5, 4);
+            if (version != LOG_BIN_VERSION) {
+                fprintf(stderr, "unsupported version %u\n", version);
+                return false;
+            }
+            ++session;
+            p += LOG_BIN_SESSION_SIZE;
+        } else if (type == LOG_BIN_FORMAT) {
+            if (end - p < 7) {
+                break;
+            }
+            uint32_t id;
+            uint16_t len;
+            memcpy(&id, p + 1, 4);
+            memcpy(&len, p + 5, 2);
+            if ((size_t) (end - p) < 7 + (size_t) len) {
+                break;
+            }
+            if (pass == 0) {
+                formats[make_pair(session, id)] = string(p + 7, len);
+            }
+            p += 7 + len;
+        } else if (type == LOG_BIN_ENTRY) {
+            if ((size_t) (end - p) < LOG_BIN_ENTRY_SIZE) {
+                break;
+            }
+            uint32_t id;
+            uint64_t stamp;
+            uint16_t len;
+            memcpy(&id, p + 2, 4);
+            memcpy(&stamp, p + 6, 8);
+            memcpy(&len, p + 14, 2);
+            if ((size_t) (end - p) < LOG_BIN_ENTRY_SIZE + len) {
+                break;
+            }
+            if (pass == 1) {
+                int level = (unsigned char) p[1];
+                time_t t = stamp / 1000000000ULL;
+                struct tm my_tm;
+                localtime_r(&t, &my_tm);
+
+                arg_reader args = {p + LOG_BIN_ENTRY_SIZE, p + LOG_BIN_ENTRY_SIZE + len};
+                map<pair<int, uint32_t>, string>::iterator it = formats.find(make_pair(session, id));
+                string text = it == formats.end() ? "<unknown format>" : render_entry(it->second, args);
+                fprintf(out, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s %s\n",
+                        my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
+                        my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, (long) (stamp % 1000000000ULL / 1000),
+                        level < 4 ? LEVELS[level] : LEVELS[1], text.c_str());
+            }
+            p += LOG_BIN_ENTRY_SIZE + len;
+        } else {
+            break;
+        }
+    }
+    if (p < end) {
+        // 进程崩溃时最后一条可能只写了一半
+        fprintf(stderr, "corrupt or truncated record at offset %ld\n", (long) (p - (data.empty() ? p : &data[0])));
+    }
+    return true;
+}
+
+static bool decode(const char *path, FILE *out) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    vector<char> data;
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(fp);
+
+    if (data.size() < LOG_BIN_SESSION_SIZE || data[0] != LOG_BIN_SESSION
+        || memcmp(&data[1], LOG_BIN_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        return false;
+    }
+
+    // 多生产者模式下格式串记录可能晚于使用它的日志项，先收集再输出
+    map<pair<int, uint32_t>, string> formats;
+    return walk(data, 0, formats, out) && walk(data, 1, formats, out);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s binary_log [...]\n", argv[0]);
+        return 1;
+    }
+    int ret = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!decode(argv[i], stdout)) {
+            ret = 1;
+        }
+    }
+    return ret;
+}
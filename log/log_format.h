@@ -0,0 +1,121 @@
+/*************************************************************
+*二进制日志的格式串解析，写日志与离线解码共用
+*写入端据此决定从va_list中按什么类型取参数，解码端据此还原文本
+*只考虑LP64平台：h/hh提升为int，l/ll/j/z/t均为64位
+**************************************************************/
+
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <string.h>
+#include <string>
+
+using namespace std;
+
+// 二进制日志的记录类型
+// 会话头：进程打开或切分日志文件时写入，之后是当前已注册的全部格式串
+// 格式串：'F' + u32编号 + u16长度 + 内容
+// 日志项：'E' + u8等级 + u32编号 + u64时间(ns) + u16参数长度 + 参数
+static const char LOG_BIN_SESSION = 'S';
+static const char LOG_BIN_FORMAT = 'F';
+static const char LOG_BIN_ENTRY = 'E';
+static const char LOG_BIN_MAGIC[4] = {'T', 'W', 'L', 'B'};
+static const unsigned int LOG_BIN_VERSION = 1;
+static const size_t LOG_BIN_SESSION_SIZE = 1 + 4 + 4 + 8;
+static const size_t LOG_BIN_ENTRY_SIZE = 1 + 1 + 4 + 8 + 2;
+
+// 一个转换说明
+// type: 'i' int, 'l' 64位整数, 'd' double, 'D' long double(按double记录), 's' 字符串, 'p' 指针,
+//       '%' 字面量百分号, 0 不支持(如%n、%ls)，之后的参数不再记录
+struct log_spec {
+    const char *begin;  // 指向'%'
+    const char *end;    // 指向转换字符之后
+    int stars;          // 宽度与精度中'*'的个数，每个'*'先消耗一个int参数
+    char type;
+};
+
+// p指向'%'，解析一个转换说明，返回其后的位置
+static inline const char *log_parse_spec(const char *p, log_spec *spec) {
+    spec->begin = p++;
+    spec->stars = 0;
+    while (*p && strchr("-+ #0'", *p)) {
+        ++p;
+    }
+    if (*p == '*') {
+        ++spec->stars;
+        ++p;
+    } else {
+        while (*p >= '0' && *p <= '9') {
+            ++p;
+        }
+    }
+    if (*p == '.') {
+        ++p;
+        if (*p == '*') {
+            ++spec->stars;
+            ++p;
+        } else {
+            while (*p >= '0' && *p <= '9') {
+                ++p;
+            }
+        }
+    }
+    bool is_long = false, is_ldouble = false;
+    while (*p && strchr("hlqjztL", *p)) {
+        if (*p == 'L') {
+            is_ldouble = true;
+        } else if (*p != 'h') {
+            is_long = true;
+        }
+        ++p;
+    }
+    char c = *p;
+    if (c) {
+        ++p;
+    }
+    spec->end = p;
+    switch (c) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            spec->type = is_long ? 'l' : 'i';
+            break;
+        case 'c':
+            spec->type = is_long ? 0 : 'i';
+            break;
+        case 's':
+            spec->type = is_long ? 0 : 's';
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec->type = is_ldouble ? 'D' : 'd';
+            break;
+        case 'p':
+            spec->type = 'p';
+            break;
+        case '%':
+            spec->type = '%';
+            break;
+        default:
+            spec->type = 0;
+            break;
+    }
+    return p;
+}
+
+// 由格式串得到参数类型序列，注册调用点时只解析一次
+static inline string log_arg_types(const char *format) {
+    string types;
+    for (const char *p = strchr(format, '%'); p; p = strchr(p, '%')) {
+        log_spec spec;
+        p = log_parse_spec(p, &spec);
+        if (spec.type == '%') {
+            continue;
+        }
+        if (spec.type == 0) {
+            break;
+        }
+        types.append(spec.stars, 'i');
+        types.push_back(spec.type);
+    }
+    return types;
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*************************************************************
+*单生产者单消费者的无锁环形字节缓冲区
+*每个写日志的线程独占一个，后台线程负责取出
+*生产者只写m_tail，消费者只写m_head，两者分别独占cache line
+**************************************************************/
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+using namespace std;
+
+class log_ring {
+public:
+    // size向上取整为2的幂
+    explicit log_ring(size_t size) {
+        m_size = 1;
+        while (m_size < size) {
+            m_size <<= 1;
+        }
+        m_mask = m_size - 1;
+        m_buf = new char[m_size];
+        m_head.store(0, memory_order_relaxed);
+        m_tail.store(0, memory_order_relaxed);
+        m_popped.store(0, memory_order_relaxed);
+        m_pushed.store(0, memory_order_relaxed);
+        m_cached_head = 0;
+    }
+
+    ~log_ring() {
+        delete[] m_buf;
+    }
+
+    // 生产者：写入一条完整日志，剩余空间不足返回false，不会写入半条
+    // 每条记录前加4字节长度，二进制日志中可能出现'\n'，不能再按行切分
+    bool push(const char *data, size_t len) {
+        size_t tail = m_tail.load(memory_order_relaxed);
+        size_t need = sizeof(uint32_t) + len;
+        if (tail + need - m_cached_head > m_size) {
+            // 缓存的head过旧时才去读消费者的cache line
+            m_cached_head = m_head.load(memory_order_acquire);
+            if (tail + need - m_cached_head > m_size) {
+                return false;
+            }
+        }
+        uint32_t n = (uint32_t) len;
+        copy_in(tail, (const char *) &n, sizeof(n));
+        copy_in(tail + sizeof(n), data, len);
+        // release保证消费者看到新的tail时数据已经写完
+        m_tail.store(tail + need, memory_order_release);
+        m_pushed.store(m_pushed.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return true;
+    }
+
+    // 消费者：取出最多max字节的完整记录，去掉长度前缀后连续存放，返回取出的字节数
+    // records累加取出的记录条数，用于按行切分
+    size_t pop(char *dst, size_t max, long long *records) {
+        size_t head = m_head.load(memory_order_relaxed);
+        size_t tail = m_tail.load(memory_order_acquire);
+        size_t out = 0;
+        size_t taken = 0;
+        while (tail - head >= sizeof(uint32_t)) {
+            uint32_t n;
+            copy_out(head, (char *) &n, sizeof(n));
+            // 多个缓冲区的数据拼在同一批次里，不能切断一条
+            if (out + n > max) {
+                break;
+            }
+            copy_out(head + sizeof(n), dst + out, n);
+            head += sizeof(n) + n;
+            out += n;
+            ++taken;
+            ++*records;
+        }
+        m_head.store(head, memory_order_release);
+        m_popped.store(m_popped.load(memory_order_relaxed) + taken, memory_order_relaxed);
+        return out;
+    }
+
+    // 消费者侧判断是否还有数据
+    bool empty() const {
+        return m_head.load(memory_order_relaxed) == m_tail.load(memory_order_acquire);
+    }
+
+    // 任意线程读取尚未取出的记录条数，只用于统计，允许与读写并发时略有偏差
+    size_t pending() const {
+        size_t popped = m_popped.load(memory_order_relaxed);
+        size_t pushed = m_pushed.load(memory_order_relaxed);
+        return pushed > popped ? pushed - popped : 0;
+    }
+
+private:
+    // 按逻辑位置读写，处理回绕
+    void copy_in(size_t at, const char *src, size_t len) {
+        size_t pos = at & m_mask;
+        size_t first = len < m_size - pos ? len : m_size - pos;
+        memcpy(m_buf + pos, src, first);
+        memcpy(m_buf, src + first, len - first);
+    }
+
+    void copy_out(size_t at, char *dst, size_t len) const {
+        size_t pos = at & m_mask;
+        size_t first = len < m_size - pos ? len : m_size - pos;
+        memcpy(dst, m_buf + pos, first);
+        memcpy(dst + first, m_buf, len - first);
+    }
+
+    char *m_buf;
+    size_t m_size;
+    size_t m_mask;
+
+    alignas(64) atomic<size_t> m_head;  // 消费者读位置
+    atomic<size_t> m_popped;            // 消费者取出的记录数，与m_head同属消费者的cache line
+    alignas(64) atomic<size_t> m_tail;  // 生产者写位置
+    atomic<size_t> m_pushed;            // 生产者写入的记录数
+    size_t m_cached_head;               // 生产者缓存的head，减少跨核读取
+    char m_pad[64 - sizeof(size_t)];
+};
+
+#endif
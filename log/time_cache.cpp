@@ -0,0 +1,103 @@
+#include <string.h>
+#include <stdio.h>
+#include "time_cache.h"
+
+// 当前分钟的起点及其格式化结果"YYYY-MM-DD HH:MM:"
+static __thread time_t t_minute = -1;
+static __thread struct tm t_minute_tm;
+static __thread char t_minute_text[24];
+static __thread int t_minute_len;
+
+// 最近一次格式化的HTTP Date
+static __thread time_t t_date_sec = -1;
+static __thread char t_date_text[32];
+
+static const char *WEEKDAYS[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                               "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// 写两位十进制数
+static inline void put2(char *p, int v) {
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+}
+
+int time_cache::log_time(char *buf, struct tm *my_tm) {
+    // CLOCK_REALTIME走vDSO，不陷入内核
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    // 时区偏移都是整分钟，同一分钟内的本地时间只差秒数
+    long sec = ts.tv_sec - t_minute;
+    if (t_minute < 0 || sec < 0 || sec >= 60) {
+        localtime_r(&ts.tv_sec, &t_minute_tm);
+        sec = t_minute_tm.tm_sec;
+        t_minute = ts.tv_sec - sec;
+        t_minute_tm.tm_sec = 0;
+        t_minute_len = snprintf(t_minute_text, sizeof(t_minute_text), "%d-%02d-%02d %02d:%02d:",
+                                t_minute_tm.tm_year + 1900, t_minute_tm.tm_mon + 1, t_minute_tm.tm_mday,
+                                t_minute_tm.tm_hour, t_minute_tm.tm_min);
+    }
+
+    int n = t_minute_len;
+    memcpy(buf, t_minute_text, n);
+    put2(buf + n, (int) sec);
+    buf[n + 2] = '.';
+    long usec = ts.tv_nsec / 1000;
+    for (int i = 8; i >= 3; --i) {
+        buf[n + i] = '0' + usec % 10;
+        usec /= 10;
+    }
+    buf[n + 9] = '\0';
+
+    if (my_tm) {
+        *my_tm = t_minute_tm;
+        my_tm->tm_sec = (int) sec;
+    }
+    return n + 9;
+}
+
+const char *time_cache::http_date(int *len) {
+    // 秒级精度，粗粒度时钟足够
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+
+    if (ts.tv_sec != t_date_sec) {
+        http_date_of(ts.tv_sec, t_date_text);
+        t_date_sec = ts.tv_sec;
+    }
+    if (len) {
+        *len = HTTP_DATE_LEN;
+    }
+    return t_date_text;
+}
+
+int time_cache::http_date_of(time_t t, char *buf) {
+    struct tm gmt;
+    gmtime_r(&t, &gmt);
+    return snprintf(buf, HTTP_DATE_LEN + 1, "%s, %02d %s %d %02d:%02d:%02d GMT",
+                    WEEKDAYS[gmt.tm_wday], gmt.tm_mday, MONTHS[gmt.tm_mon], gmt.tm_year + 1900,
+                    gmt.tm_hour, gmt.tm_min, gmt.tm_sec);
+}
+
+// 只接受IMF-fixdate，浏览器回传的If-Modified-Since就是服务器给出的Last-Modified原文
+time_t time_cache::parse_http_date(const char *text) {
+    char wday[4], mon[4];
+    struct tm gmt;
+    memset(&gmt, 0, sizeof(gmt));
+    if (sscanf(text, "%3s, %d %3s %d %d:%d:%d GMT", wday, &gmt.tm_mday, mon, &gmt.tm_year,
+               &gmt.tm_hour, &gmt.tm_min, &gmt.tm_sec) != 7) {
+        return -1;
+    }
+    gmt.tm_mon = -1;
+    for (int i = 0; i < 12; ++i) {
+        if (strcmp(mon, MONTHS[i]) == 0) {
+            gmt.tm_mon = i;
+        }
+    }
+    if (gmt.tm_mon < 0) {
+        return -1;
+    }
+    gmt.tm_year -= 1900;
+    return timegm(&gmt);
+}
@@ -0,0 +1,31 @@
+/*************************************************************
+*每线程时间戳缓存
+*localtime会加锁并可能检查/etc/localtime，只在分钟变化时调用一次，
+*同一分钟内只重新格式化秒和微秒部分
+*HTTP Date头使用粗粒度时钟，每秒最多格式化一次
+**************************************************************/
+
+#ifndef TIME_CACHE_H
+#define TIME_CACHE_H
+
+#include <time.h>
+
+class time_cache {
+public:
+    // 日志时间"YYYY-MM-DD HH:MM:SS.uuuuuu"，buf至少32字节，返回长度
+    // my_tm非空时同时给出分解后的本地时间，供按天切分判断
+    static int log_time(char *buf, struct tm *my_tm);
+
+    // 当前时间的HTTP Date，如"Sun, 06 Nov 1994 08:49:37 GMT"，返回线程私有缓存，len非空时给出长度
+    static const char *http_date(int *len);
+
+    // 把t格式化为HTTP日期，用于Last-Modified，buf至少HTTP_DATE_LEN + 1字节，返回长度
+    static int http_date_of(time_t t, char *buf);
+
+    // 解析HTTP日期，格式不对时返回-1
+    static time_t parse_http_date(const char *text);
+
+    static const int HTTP_DATE_LEN = 29;
+};
+
+#endif
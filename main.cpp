@@ -14,8 +14,17 @@ int main(int argc, char* argv[]) {
 
     // 初始化
     server.init(config.PORT, user, passwd, databasename, config.LOGWrite,
-                config.OPT_LINGER, config.TRIGMode, config.sql_num, config.thread_num,
-                config.close_log, config.actor_model);
+                config.OPT_LINGER, config.TRIGMode, config.sql_num, config.sql_min_num, config.thread_num,
+                config.close_log, config.actor_model, config.user_snapshot,
+                config.sql_mode, config.log_binary, config.log_level, config.log_split_mb,
+                config.log_gzip, config.metrics_port, config.slow_ms,
+                config.overload_ms, config.ip_conns, config.ip_rate,
+                config.loop_cpus, config.worker_cpus, config.log_cpus,
+                config.sock_opts, config.handoff_path, config.processes,
+                config.stats, config.cache_control);
+
+    // 多进程模式：master在这里fork工作进程并负责重启，之后的初始化都在工作进程中进行
+    server.prefork();
 
     // 日志
     server.log_write();
@@ -32,6 +41,9 @@ int main(int argc, char* argv[]) {
     // 监听
     server.eventListen();
 
+    // 绑定CPU
+    server.cpu_affinity();
+
     // 运行
     server.eventLoop();
 
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <vector>
+#include "metrics.h"
+#include "../lock/locker.h"
+#include "../log/log.h"
+
+__thread metrics::shard *metrics::s_local = NULL;
+
+struct gauge {
+    const char *name;
+    const char *help;
+    long (*fn)(void *);
+    void *arg;
+};
+
+// 分片只增不减，线程退出后其计数仍计入总数
+static locker s_lock;
+static vector<void *> s_shards;
+static vector<gauge> s_gauges;
+static int m_close_log = 1;
+
+// 与http_conn::HTTP_CODE的顺序一致
+static const char *REQUEST_CODES[M_REQUEST_CODES] = {
+        "no_request", "get_request", "bad_request", "no_resource",
+        "forbidden_request", "file_request", "internal_error", "closed_connection",
+        "not_modified"};
+
+struct counter_desc {
+    int id;
+    const char *name;
+    const char *help;
+};
+
+static const counter_desc COUNTERS[] = {
+        {M_ACCEPTS,         "tinyweb_accepts_total",           "Accepted connections."},
+        {M_ACCEPT_REJECTED, "tinyweb_accept_rejected_total",   "Connections answered with 503 because MAX_FD was reached."},
+        {M_BYTES_SENT,      "tinyweb_bytes_sent_total",        "Response bytes written to sockets."},
+        {M_TIMER_EXPIRED,   "tinyweb_timer_expirations_total", "Idle connections closed by the timer."},
+        {M_SHED_ADMISSION,  "tinyweb_shed_admission_total",    "Requests answered with 503 by the main thread while overloaded or the queue was full."},
+        {M_SHED_SOJOURN,    "tinyweb_shed_sojourn_total",      "Requests answered with 503 after queueing too long while overloaded."},
+        {M_ACCEPT_PAUSED,   "tinyweb_accept_pauses_total",     "Times accepting new connections was paused by overload."},
+        {M_IP_CONN_LIMITED, "tinyweb_ip_conn_limited_total",   "Connections answered with 429 because their address had too many open."},
+        {M_IP_RATE_LIMITED, "tinyweb_ip_rate_limited_total",   "Requests answered with 429 because their address exceeded its rate."},
+};
+
+static const counter_desc HISTS[H_HIST_NUM] = {
+        {H_DB_WAIT,      "tinyweb_db_wait_seconds",        "Time spent waiting for a database connection."},
+        {H_STAGE_QUEUE,  "tinyweb_stage_queue_seconds",    "From the read event to a worker processing the request."},
+        {H_STAGE_PARSE,  "tinyweb_stage_parse_seconds",    "Parsing the request line, headers and body."},
+        {H_STAGE_HANDLE, "tinyweb_stage_handle_seconds",   "do_request: login/register, database, stat and mmap."},
+        {H_STAGE_BUILD,  "tinyweb_stage_build_seconds",    "process_write: formatting the response headers."},
+        {H_STAGE_SEND,   "tinyweb_stage_send_seconds",     "From the response being ready to the last byte written."},
+        {H_REQUEST,      "tinyweb_request_seconds",        "From the read event to the last response byte written."},
+};
+
+metrics::shard *metrics::register_thread() {
+    // 按缓存行对齐并补齐到缓存行整数倍，避免与其他线程的分片共享缓存行
+    size_t size = (sizeof(shard) + 63) & ~(size_t) 63;
+    void *p = NULL;
+    if (posix_memalign(&p, 64, size) != 0) {
+        abort();
+    }
+    memset(p, 0, size);
+    s_lock.lock();
+    s_shards.push_back(p);
+    s_lock.unlock();
+    return (shard *) p;
+}
+
+void metrics::add_gauge(const char *name, const char *help, long (*fn)(void *), void *arg) {
+    gauge g = {name, help, fn, arg};
+    s_lock.lock();
+    s_gauges.push_back(g);
+    s_lock.unlock();
+}
+
+static void append(string &out, const char *fmt, ...) {
+    char buf[256];
+    va_list valst;
+    va_start(valst, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, valst);
+    va_end(valst);
+    if (n > 0) {
+        out.append(buf, n < (int) sizeof(buf) ? n : sizeof(buf) - 1);
+    }
+}
+
+void metrics::totals(unsigned long counters[M_COUNTER_NUM]) {
+    memset(counters, 0, sizeof(unsigned long) * M_COUNTER_NUM);
+    s_lock.lock();
+    for (size_t i = 0; i < s_shards.size(); ++i) {
+        shard *s = (shard *) s_shards[i];
+        for (int c = 0; c < M_COUNTER_NUM; ++c) {
+            counters[c] += s->counters[c].load(memory_order_relaxed);
+        }
+    }
+    s_lock.unlock();
+}
+
+string metrics::render() {
+    unsigned long counters[M_COUNTER_NUM] = {0};
+    unsigned long buckets[H_HIST_NUM][HIST_BUCKETS] = {{0}};
+    unsigned long sums[H_HIST_NUM] = {0};
+    unsigned long cpus[MAX_CPUS] = {0};
+
+    s_lock.lock();
+    for (size_t i = 0; i < s_shards.size(); ++i) {
+        shard *s = (shard *) s_shards[i];
+        for (int c = 0; c < M_COUNTER_NUM; ++c) {
+            counters[c] += s->counters[c].load(memory_order_relaxed);
+        }
+        for (int h = 0; h < H_HIST_NUM; ++h) {
+            for (int b = 0; b < HIST_BUCKETS; ++b) {
+                buckets[h][b] += s->buckets[h][b].load(memory_order_relaxed);
+            }
+            sums[h] += s->sums[h].load(memory_order_relaxed);
+        }
+        for (int c = 0; c < MAX_CPUS; ++c) {
+            cpus[c] += s->cpus[c].load(memory_order_relaxed);
+        }
+    }
+    vector<gauge> gauges = s_gauges;
+    s_lock.unlock();
+
+    string out;
+    for (size_t i = 0; i < sizeof(COUNTERS) / sizeof(COUNTERS[0]); ++i) {
+        append(out, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", COUNTERS[i].name, COUNTERS[i].help,
+               COUNTERS[i].name, COUNTERS[i].name, counters[COUNTERS[i].id]);
+    }
+
+    out.append("# HELP tinyweb_requests_total Requests by parse result.\n# TYPE tinyweb_requests_total counter\n");
+    for (int i = 0; i < M_REQUEST_CODES; ++i) {
+        append(out, "tinyweb_requests_total{code=\"%s\"} %lu\n", REQUEST_CODES[i], counters[M_REQUESTS + i]);
+    }
+
+    // 只输出处理过请求的CPU
+    out.append("# HELP tinyweb_requests_by_cpu_total Requests processed on each CPU.\n"
+               "# TYPE tinyweb_requests_by_cpu_total counter\n");
+    for (int c = 0; c < MAX_CPUS; ++c) {
+        if (cpus[c]) {
+            append(out, "tinyweb_requests_by_cpu_total{cpu=\"%d\"} %lu\n", c, cpus[c]);
+        }
+    }
+
+    for (size_t i = 0; i < gauges.size(); ++i) {
+        append(out, "# HELP %s %s\n# TYPE %s gauge\n%s %ld\n", gauges[i].name, gauges[i].help,
+               gauges[i].name, gauges[i].name, gauges[i].fn(gauges[i].arg));
+    }
+
+    for (int h = 0; h < H_HIST_NUM; ++h) {
+        const char *name = HISTS[h].name;
+        append(out, "# HELP %s %s\n# TYPE %s histogram\n", name, HISTS[h].help, name);
+        unsigned long total = 0;
+        for (int b = 0; b < HIST_BUCKETS; ++b) {
+            total += buckets[h][b];
+            if (b == HIST_BUCKETS - 1) {
+                append(out, "%s_bucket{le=\"+Inf\"} %lu\n", name, total);
+            } else {
+                append(out, "%s_bucket{le=\"%.6f\"} %lu\n", name, (double) (1UL << b) / 1e6, total);
+            }
+        }
+        append(out, "%s_sum %.6f\n%s_count %lu\n", name, sums[h] / 1e6, name, total);
+    }
+    return out;
+}
+
+// 读取请求行，只响应GET /metrics
+static void serve_one(int fd) {
+    struct timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char req[1024];
+    int len = 0;
+    while (len < (int) sizeof(req) - 1) {
+        int n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) {
+            break;
+        }
+    }
+    req[len] = '\0';
+
+    string body;
+    const char *status;
+    if (strncmp(req, "GET /metrics ", 13) == 0 || strncmp(req, "GET /metrics?", 13) == 0) {
+        status = "200 OK";
+        body = metrics::render();
+    } else {
+        status = "404 Not Found";
+        body = "try /metrics\n";
+    }
+    char head[160];
+    int hlen = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                            "Content-Length: %lu\r\nConnection: close\r\n\r\n",
+                        status, (unsigned long) body.size());
+    string resp(head, hlen);
+    resp += body;
+    for (size_t off = 0; off < resp.size();) {
+        ssize_t n = send(fd, resp.data() + off, resp.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) {
+            break;
+        }
+        off += n;
+    }
+    close(fd);
+}
+
+// 管理端口的监听socket，stop后置为-1
+static atomic<int> s_listenfd(-1);
+static atomic<bool> s_stopped(false);
+
+// 热重启时旧进程排空期间仍占用管理端口，新进程在这段时间内重试bind
+static const int BIND_RETRIES = 50;
+static const int BIND_RETRY_MS = 100;
+
+static int listen_port(int port) {
+    for (int i = 0; i < BIND_RETRIES && !s_stopped.load(); ++i) {
+        int fd = socket(PF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            LOG_ERROR("metrics socket error:%d", errno);
+            return -1;
+        }
+        int flag = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (bind(fd, (struct sockaddr *) &address, sizeof(address)) == 0 && listen(fd, 16) == 0) {
+            return fd;
+        }
+        int err = errno;
+        close(fd);
+        if (err != EADDRINUSE) {
+            LOG_ERROR("metrics listen on port %d failed:%d", port, err);
+            return -1;
+        }
+        usleep(BIND_RETRY_MS * 1000);
+    }
+    LOG_ERROR("metrics port %d still in use", port);
+    return -1;
+}
+
+// 采集频率很低，逐个阻塞处理即可，不占用主线程的epoll
+// bind在本线程中进行，热重启等待旧进程释放端口时不阻塞主线程
+void *metrics::serve_thread(void *arg) {
+    int port = (int) (long) arg;
+    int listenfd = listen_port(port);
+    if (listenfd < 0) {
+        return NULL;
+    }
+    s_listenfd.store(listenfd);
+    // stop可能发生在bind期间
+    if (s_stopped.load()) {
+        stop();
+        return NULL;
+    }
+    LOG_INFO("metrics listening on port %d", port);
+    while (true) {
+        int fd = accept(listenfd, NULL, NULL);
+        if (fd < 0) {
+            if (s_stopped.load()) {
+                break;
+            }
+            if (errno != EINTR) {
+                LOG_ERROR("metrics accept error:%d", errno);
+            }
+            continue;
+        }
+        serve_one(fd);
+    }
+    return NULL;
+}
+
+bool metrics::start(int port, int close_log) {
+    m_close_log = close_log;
+    if (port <= 0) {
+        return true;
+    }
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, serve_thread, (void *) (long) port) != 0) {
+        return false;
+    }
+    pthread_detach(tid);
+    return true;
+}
+
+void metrics::stop() {
+    s_stopped.store(true);
+    int fd = s_listenfd.exchange(-1);
+    if (fd >= 0) {
+        // shutdown唤醒阻塞在accept上的管理线程
+        shutdown(fd, SHUT_RDWR);
+        close(fd);
+    }
+}
@@ -0,0 +1,123 @@
+/*************************************************************
+*运行指标，按Prometheus文本格式导出
+*计数器与直方图按线程分片：每个线程首次记录时分配自己的分片(按缓存行对齐)，
+*只有所属线程写入，写入路径无锁、无原子读改写，采集时再汇总所有分片
+*瞬时值(连接数、队列深度等)注册为回调，在采集时读取
+*由独立的管理端口提供：curl http://127.0.0.1:端口/metrics
+**************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <time.h>
+#include <sched.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+using namespace std;
+
+// 计数器编号
+enum metric_counter {
+    M_ACCEPTS = 0,          // 成功accept的连接
+    M_ACCEPT_REJECTED,      // 连接数达到上限被拒绝
+    M_BYTES_SENT,           // 响应发送的字节数
+    M_TIMER_EXPIRED,        // 定时器到期关闭的非活动连接
+    M_SHED_ADMISSION,       // 过载或请求队列已满，主线程直接返回503的请求
+    M_SHED_SOJOURN,         // 过载时排队过久，返回503的请求
+    M_ACCEPT_PAUSED,        // 因过载暂停accept的次数
+    M_IP_CONN_LIMITED,      // 单个IP连接数达到上限被拒绝的连接
+    M_IP_RATE_LIMITED,      // 超过单个IP请求速率，返回429的请求
+    M_REQUESTS,             // 请求处理结果，按http_conn::HTTP_CODE区分，占M_REQUEST_CODES个位置
+    M_REQUEST_CODES = 9,
+    M_COUNTER_NUM = M_REQUESTS + M_REQUEST_CODES
+};
+
+// 直方图编号，单位微秒
+enum metric_hist {
+    H_DB_WAIT = 0,          // 从连接池获取数据库连接的等待时间
+    H_STAGE_QUEUE,          // 请求各阶段耗时，见http_conn::stage_times
+    H_STAGE_PARSE,
+    H_STAGE_HANDLE,
+    H_STAGE_BUILD,
+    H_STAGE_SEND,
+    H_REQUEST,              // 从读到请求到响应发送完毕
+    H_HIST_NUM
+};
+
+class metrics {
+public:
+    // 直方图按2的幂分桶：第i个桶为(2^(i-1), 2^i]微秒，最后一个桶为+Inf
+    static const int HIST_BUCKETS = 24;
+    // 按CPU统计请求数时支持的最大CPU编号
+    static const int MAX_CPUS = 256;
+
+    static inline void inc(int counter, unsigned long n = 1) {
+        shard *s = local();
+        s->counters[counter].store(s->counters[counter].load(memory_order_relaxed) + n, memory_order_relaxed);
+    }
+
+    static inline void observe(int hist, unsigned long us) {
+        shard *s = local();
+        int b = us <= 1 ? 0 : 64 - __builtin_clzl(us - 1);
+        if (b >= HIST_BUCKETS) {
+            b = HIST_BUCKETS - 1;
+        }
+        s->buckets[hist][b].store(s->buckets[hist][b].load(memory_order_relaxed) + 1, memory_order_relaxed);
+        s->sums[hist].store(s->sums[hist].load(memory_order_relaxed) + us, memory_order_relaxed);
+    }
+
+    // 按当前所在CPU计数，用于检查线程绑核是否生效
+    static inline void inc_cpu() {
+        int cpu = sched_getcpu();
+        if (cpu >= 0 && cpu < MAX_CPUS) {
+            shard *s = local();
+            s->cpus[cpu].store(s->cpus[cpu].load(memory_order_relaxed) + 1, memory_order_relaxed);
+        }
+    }
+
+    // 单调时钟，单位纳秒，用于阶段计时
+    static inline uint64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // 注册采集时读取的瞬时值
+    static void add_gauge(const char *name, const char *help, long (*fn)(void *), void *arg);
+
+    // 汇总所有分片，生成Prometheus文本
+    static string render();
+
+    // 汇总所有分片的计数器，供共享内存统计段使用
+    static void totals(unsigned long counters[M_COUNTER_NUM]);
+
+    // 在port上启动管理线程响应/metrics，port为0时不启动
+    static bool start(int port, int close_log);
+
+    // 关闭管理端口，热重启时旧进程把端口让给新进程
+    static void stop();
+
+private:
+    struct shard {
+        atomic<unsigned long> counters[M_COUNTER_NUM];
+        atomic<unsigned long> buckets[H_HIST_NUM][HIST_BUCKETS];
+        atomic<unsigned long> sums[H_HIST_NUM];
+        atomic<unsigned long> cpus[MAX_CPUS];
+    };
+
+    static inline shard *local() {
+        if (!s_local) {
+            s_local = register_thread();
+        }
+        return s_local;
+    }
+
+    static shard *register_thread();
+
+    static void *serve_thread(void *arg);
+
+    static __thread shard *s_local;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stats_shm.h"
+
+struct publisher {
+    stats_slot *slot;
+    int worker;
+    stats_shm::fill_fn fill;
+    void *arg;
+};
+
+string stats_shm::name(int port) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "/tinyweb.%d", port);
+    return buf;
+}
+
+static atomic<bool> s_stopped(false);
+
+// 每个槽位只有一个统计线程写；序号按偶数起算，上一个进程在写入中途崩溃、
+// 或热重启交接时新旧进程短暂同时写入，留下奇数序号时也能恢复
+void stats_shm::publish(stats_slot *slot, const stats_values &v) {
+    uint32_t seq = slot->seq.load(memory_order_relaxed) & ~1u;
+    slot->seq.store(seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot->v, &v, sizeof(v));
+    slot->seq.store(seq + 2, memory_order_release);
+}
+
+bool stats_shm::read(const stats_segment *seg, int slot, stats_values &out) {
+    const stats_slot *s = &seg->slots[slot];
+    for (int i = 0; i < 100; ++i) {
+        uint32_t before = s->seq.load(memory_order_acquire);
+        if (0 == before) {
+            return false;  // 从未写入
+        }
+        if (before & 1) {
+            continue;
+        }
+        memcpy(&out, (const void *) &s->v, sizeof(out));
+        atomic_thread_fence(memory_order_acquire);
+        if (s->seq.load(memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void *stats_shm::publish_thread(void *arg) {
+    publisher *p = (publisher *) arg;
+    stats_values v;
+    while (!s_stopped.load(memory_order_relaxed)) {
+        memset(&v, 0, sizeof(v));
+        p->fill(v, p->arg);
+        v.pid = getpid();
+        v.worker = p->worker;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        v.updated_ms = ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+        publish(p->slot, v);
+        usleep(STATS_INTERVAL_MS * 1000);
+    }
+    return NULL;
+}
+
+// 映射已存在的段，create为true时不存在则创建
+static stats_segment *map_segment(int port, bool create) {
+    string path = stats_shm::name(port);
+    int fd = shm_open(path.c_str(), create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (create && ftruncate(fd, sizeof(stats_segment)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(stats_segment)) {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(stats_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return MAP_FAILED == p ? NULL : (stats_segment *) p;
+}
+
+bool stats_shm::create(int port) {
+    stats_segment *seg = map_segment(port, true);
+    if (!seg) {
+        return false;
+    }
+    // 新建的段或旧版本布局的段，逐个槽位清空后写入版本；已有的同版本段保持不变，
+    // 上次运行留下的槽位由读取方按pid是否存在判断，热重启时也不会清掉旧进程正在写的槽位
+    if (seg->magic != MAGIC || seg->version != VERSION) {
+        seg->magic = 0;
+        for (int i = 0; i < MAX_WORKERS; ++i) {
+            seg->slots[i].seq.store(0, memory_order_relaxed);
+            seg->slots[i].v = stats_values();
+        }
+        seg->version = VERSION;
+        atomic_thread_fence(memory_order_release);
+        seg->magic = MAGIC;
+    }
+    munmap(seg, sizeof(stats_segment));
+    return true;
+}
+
+bool stats_shm::start(int port, int worker, fill_fn fill, void *arg) {
+    int slot = worker < 0 ? 0 : worker;
+    if (slot >= MAX_WORKERS) {
+        return false;
+    }
+    // 段由create初始化，这里只打开，多个工作进程同时启动时互不干扰
+    stats_segment *seg = map_segment(port, false);
+    if (!seg) {
+        return false;
+    }
+    void *p = seg;
+    if (seg->magic != MAGIC || seg->version != VERSION) {
+        munmap(p, sizeof(stats_segment));
+        return false;
+    }
+
+    publisher *pub = new publisher;
+    pub->slot = &seg->slots[slot];
+    pub->worker = worker;
+    pub->fill = fill;
+    pub->arg = arg;
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, publish_thread, pub) != 0) {
+        delete pub;
+        munmap(p, sizeof(stats_segment));
+        return false;
+    }
+    pthread_detach(tid);
+    return true;
+}
+
+void stats_shm::stop() {
+    s_stopped.store(true, memory_order_relaxed);
+}
+
+const stats_segment *stats_shm::attach(int port) {
+    string path = name(port);
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(stats_segment)) {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(stats_segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p) {
+        return NULL;
+    }
+    const stats_segment *seg = (const stats_segment *) p;
+    if (seg->magic != MAGIC || seg->version != VERSION) {
+        munmap(p, sizeof(stats_segment));
+        return NULL;
+    }
+    return seg;
+}
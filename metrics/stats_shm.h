@@ -0,0 +1,84 @@
+/*************************************************************
+*共享内存统计段，供外部工具tinytop只读映射后实时显示
+*段名为/tinyweb.端口(位于/dev/shm)，第i个工作进程使用槽位i，单进程模式使用槽位0
+*统计线程每隔STATS_INTERVAL_MS把当前值写入自己的槽位，用seqlock保护：
+*   写入前后序号各加1，奇数表示正在写；读取方在读取前后序号一致且为偶数时才采用
+*读取方不需要连接服务器，过载暂停accept、管理端口无法响应时仍能查看；
+*进程卡死时槽位的更新时间停止变化，工具据此标记为stale
+**************************************************************/
+
+#ifndef STATS_SHM_H
+#define STATS_SHM_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+using namespace std;
+
+// 一次发布的统计值，计数器为累计值，速率由读取方按两次读取的差值计算
+struct stats_values {
+    int32_t pid;
+    int32_t worker;          // 工作进程编号，单进程为-1
+    uint64_t updated_ms;     // 发布时的CLOCK_REALTIME，毫秒
+    int64_t connections;     // 当前连接数
+    int64_t queue_depth;     // 线程池队列中等待的请求
+    int64_t db_used;         // 正在使用的数据库连接
+    int64_t db_open;         // 已建立的数据库连接(使用中+空闲)，弹性连接池下小于上限
+    int64_t log_backlog;     // 异步日志队列或环形缓冲区中等待的条数
+    uint64_t requests;       // 处理完的请求(不含未读完的)
+    uint64_t accepts;        // accept的连接
+    uint64_t bytes_sent;     // 响应发送的字节数
+    uint64_t shed;           // 过载返回503的请求(含MAX_FD)
+    uint64_t limited;        // 按IP限流返回429的连接和请求
+    uint64_t accept_pauses;  // 过载暂停accept的次数
+};
+
+// 按缓存行对齐，不同工作进程的槽位不共享缓存行
+struct alignas(64) stats_slot {
+    atomic<uint32_t> seq;
+    stats_values v;
+};
+
+// 固定MAX_WORKERS个槽位，每个槽位128字节
+struct stats_segment {
+    uint32_t magic;
+    uint32_t version;
+    stats_slot slots[64];    // stats_shm::MAX_WORKERS
+};
+
+class stats_shm {
+public:
+    static const uint32_t MAGIC = 0x54575354;  // "TSWT"
+    static const uint32_t VERSION = 2;
+    static const int MAX_WORKERS = 64;
+    static const int STATS_INTERVAL_MS = 200;
+
+    // 统计线程每次发布前调用，填充除pid、worker、updated_ms之外的字段
+    typedef void (*fill_fn)(stats_values &v, void *arg);
+
+    // 服务器调用：创建并初始化port对应的段，在任何工作进程发布之前调用一次
+    // 多进程模式下由master在fork之前调用
+    static bool create(int port);
+
+    // 服务器调用：打开已初始化的段，启动统计线程写入worker对应的槽位
+    static bool start(int port, int worker, fill_fn fill, void *arg);
+
+    // 停止发布，热重启时旧进程交出槽位给新进程
+    static void stop();
+
+    // 读取方调用：只读映射port对应的段，失败返回NULL
+    static const stats_segment *attach(int port);
+
+    // 按seqlock读取一个槽位的一致快照，槽位从未写入或多次重试仍在写时返回false
+    static bool read(const stats_segment *seg, int slot, stats_values &out);
+
+    static string name(int port);
+
+private:
+    static void publish(stats_slot *slot, const stats_values &v);
+
+    static void *publish_thread(void *arg);
+};
+
+#endif
@@ -0,0 +1,144 @@
+/*************************************************************
+*共享内存统计段的实时查看工具，类似top
+*用法：./tinytop [-p 端口] [-d 刷新间隔秒] [-n 刷新次数] [-b]
+*只读映射/dev/shm/tinyweb.端口，不连接服务器；服务器过载、暂停accept时也能查看
+*每个工作进程一行，速率按两次刷新之间的计数器差值计算；DB列为使用中/已建立的数据库连接数
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "stats_shm.h"
+
+// 超过该时间没有更新的槽位标记为stale，统计线程每STATS_INTERVAL_MS更新一次
+static const uint64_t STALE_MS = 2000;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -p port      server port (9006)\n"
+            "  -d seconds   refresh interval (1)\n"
+            "  -n count     number of refreshes, 0 for unlimited (0)\n"
+            "  -b           batch mode: append instead of redrawing the screen\n",
+            prog);
+}
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+// 按两次快照计算每秒速率，pid变化(工作进程被重启)时计数器从0开始，不计算
+static double rate(uint64_t cur, uint64_t prev, double seconds) {
+    return cur >= prev && seconds > 0 ? (cur - prev) / seconds : 0;
+}
+
+int main(int argc, char *argv[]) {
+    int port = 9006;
+    double interval = 1;
+    int count = 0;
+    bool batch = false;
+    int c;
+    while ((c = getopt(argc, argv, "p:d:n:bh")) != -1) {
+        switch (c) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'd':
+                interval = atof(optarg);
+                break;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'b':
+                batch = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (interval <= 0) {
+        interval = 1;
+    }
+
+    const stats_segment *seg = stats_shm::attach(port);
+    if (!seg) {
+        fprintf(stderr, "cannot attach %s: %s (server not running with -S 1?)\n",
+                stats_shm::name(port).c_str(), errno ? strerror(errno) : "bad segment");
+        return 1;
+    }
+
+    stats_values prev[stats_shm::MAX_WORKERS];
+    bool has_prev[stats_shm::MAX_WORKERS] = {false};
+    for (int i = 0; i < stats_shm::MAX_WORKERS; ++i) {
+        has_prev[i] = stats_shm::read(seg, i, prev[i]);
+    }
+
+    for (int round = 0; 0 == count || round < count; ++round) {
+        usleep((useconds_t) (interval * 1000000));
+        uint64_t now = now_ms();
+        if (!batch) {
+            printf("\033[H\033[2J");
+        }
+        time_t t = now / 1000;
+        char when[32];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+        printf("tinyweb :%d  %s\n", port, when);
+        printf("%4s %8s %-6s %7s %9s %8s %6s %8s %6s %8s %8s %7s %8s\n",
+               "WID", "PID", "STATE", "CONNS", "REQ/S", "ACC/S", "QUEUE", "DB", "LOG",
+               "503/S", "429/S", "PAUSES", "MB/S");
+
+        double tot_req = 0, tot_acc = 0, tot_shed = 0, tot_lim = 0, tot_mb = 0;
+        long tot_conns = 0, tot_queue = 0;
+        int live = 0;
+        for (int i = 0; i < stats_shm::MAX_WORKERS; ++i) {
+            stats_values cur;
+            if (!stats_shm::read(seg, i, cur)) {
+                continue;
+            }
+            // 上次运行留下的槽位，进程已不存在
+            if (kill(cur.pid, 0) < 0 && ESRCH == errno) {
+                has_prev[i] = false;
+                continue;
+            }
+            const char *state = now - cur.updated_ms > STALE_MS ? "stale" : "up";
+            bool same = has_prev[i] && prev[i].pid == cur.pid;
+            double secs = same ? (cur.updated_ms - prev[i].updated_ms) / 1000.0 : 0;
+            double req = same ? rate(cur.requests, prev[i].requests, secs) : 0;
+            double acc = same ? rate(cur.accepts, prev[i].accepts, secs) : 0;
+            double shed = same ? rate(cur.shed, prev[i].shed, secs) : 0;
+            double lim = same ? rate(cur.limited, prev[i].limited, secs) : 0;
+            double mb = same ? rate(cur.bytes_sent, prev[i].bytes_sent, secs) / (1 << 20) : 0;
+            char db[24];
+            snprintf(db, sizeof(db), "%ld/%ld", (long) cur.db_used, (long) cur.db_open);
+            printf("%4d %8d %-6s %7ld %9.0f %8.0f %6ld %8s %6ld %8.0f %8.0f %7lu %8.2f\n",
+                   cur.worker, cur.pid, state, (long) cur.connections, req, acc, (long) cur.queue_depth, db,
+                   (long) cur.log_backlog, shed, lim, (unsigned long) cur.accept_pauses, mb);
+
+            tot_req += req;
+            tot_acc += acc;
+            tot_shed += shed;
+            tot_lim += lim;
+            tot_mb += mb;
+            tot_conns += cur.connections;
+            tot_queue += cur.queue_depth;
+            ++live;
+            prev[i] = cur;
+            has_prev[i] = true;
+        }
+        if (live > 1) {
+            printf("%4s %8s %-6s %7ld %9.0f %8.0f %6ld %8s %6s %8.0f %8.0f %7s %8.2f\n",
+                   "all", "", "", tot_conns, tot_req, tot_acc, tot_queue, "", "", tot_shed, tot_lim, "", tot_mb);
+        } else if (0 == live) {
+            printf("no live workers\n");
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ip_limit.h"
+
+void ip_limit::init(int max_conns, int rate) {
+    m_max_conns = max_conns > 0 ? max_conns : 0;
+    m_rate = rate > 0 ? rate : 0;
+    if (!enabled()) {
+        return;
+    }
+    m_burst = m_rate;
+    m_rate_per_ms = m_rate / 1000.0f;
+    m_idle_ms = m_rate > 0 ? 1000 : 0;
+
+    // 按缓存行对齐，一次探测通常落在同一缓存行内
+    void *p = NULL;
+    if (posix_memalign(&p, 64, sizeof(slot) * TABLE_SIZE) != 0) {
+        abort();
+    }
+    memset(p, 0, sizeof(slot) * TABLE_SIZE);
+    m_table = (slot *) p;
+}
+
+ip_limit::slot *ip_limit::find(uint32_t ip, bool create) {
+    uint32_t h = hash(ip);
+    slot *reuse = NULL;
+    uint32_t now = 0;
+    for (int i = 0; i < MAX_PROBE; ++i) {
+        slot *s = &m_table[(h + i) & (TABLE_SIZE - 1)];
+        uint32_t key = s->ip.load(memory_order_acquire);
+        if (key == ip) {
+            return s;
+        }
+        if (!create || reuse) {
+            continue;
+        }
+        if (0 == key) {
+            reuse = s;
+            continue;
+        }
+        // 没有连接且令牌桶早已补满的表项，复用时与新建等价
+        if (0 == s->conns.load(memory_order_relaxed)) {
+            if (0 == now) {
+                now = now_ms();
+            }
+            if (now - s->last_ms >= m_idle_ms) {
+                reuse = s;
+            }
+        }
+    }
+    if (reuse) {
+        reuse->conns.store(0, memory_order_relaxed);
+        reuse->tokens = m_burst;
+        reuse->last_ms = now ? now : now_ms();
+        reuse->ip.store(ip, memory_order_release);
+    }
+    return reuse;
+}
@@ -0,0 +1,123 @@
+/*************************************************************
+*按客户端IP限流：每个IP一个令牌桶限制请求速率，同时限制并发连接数
+*固定大小的开放寻址哈希表，启动时一次分配，运行中不再分配内存
+*   令牌桶只由主线程(accept与投递请求)读写，不加锁
+*   连接数在主线程增加，关闭连接时可能在工作线程减少，使用原子变量
+*表项不需要定期清理：连接数为0且距上次访问已超过补满令牌桶的时间，
+*该表项与新建的表项等价，可以直接被其他IP复用
+**************************************************************/
+
+#ifndef IP_LIMIT_H
+#define IP_LIMIT_H
+
+#include <time.h>
+#include <stdint.h>
+#include <atomic>
+
+using namespace std;
+
+class ip_limit {
+public:
+    // 表项数，须为2的幂；每项16字节，共1MB
+    static const int TABLE_SIZE = 1 << 16;
+    // 冲突时最多向后探测的表项数
+    static const int MAX_PROBE = 8;
+
+    static ip_limit *get_instance() {
+        static ip_limit instance;
+        return &instance;
+    }
+
+    // max_conns为单个IP的最大并发连接数，rate为每秒请求数，突发上限为1秒的请求数；0为不限制
+    void init(int max_conns, int rate);
+
+    bool enabled() const {
+        return m_max_conns > 0 || m_rate > 0;
+    }
+
+    // 主线程accept后调用，返回false表示该IP的连接数已达上限
+    bool on_connect(uint32_t ip) {
+        if (!enabled()) {
+            return true;
+        }
+        slot *s = find(ip, true);
+        if (!s) {
+            return true;  // 附近表项都在使用中，不限制
+        }
+        if (m_max_conns > 0 && (int) s->conns.load(memory_order_relaxed) >= m_max_conns) {
+            return false;
+        }
+        s->conns.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    // 连接关闭时调用，与http_conn::m_user_count同步减少
+    void on_close(uint32_t ip) {
+        if (!enabled()) {
+            return;
+        }
+        slot *s = find(ip, false);
+        if (!s) {
+            return;
+        }
+        uint32_t n = s->conns.load(memory_order_relaxed);
+        while (n > 0 && !s->conns.compare_exchange_weak(n, n - 1, memory_order_relaxed)) {
+        }
+    }
+
+    // 主线程投递请求前调用，取一个令牌，返回false表示超过速率
+    bool on_request(uint32_t ip) {
+        if (m_rate <= 0) {
+            return true;
+        }
+        slot *s = find(ip, true);
+        if (!s) {
+            return true;
+        }
+        uint32_t now = now_ms();
+        uint32_t elapsed = now - s->last_ms;
+        if (elapsed > 0) {
+            float tokens = s->tokens + elapsed * m_rate_per_ms;
+            s->tokens = tokens > m_burst ? m_burst : tokens;
+            s->last_ms = now;
+        }
+        if (s->tokens < 1.0f) {
+            return false;
+        }
+        s->tokens -= 1.0f;
+        return true;
+    }
+
+private:
+    struct slot {
+        atomic<uint32_t> ip;      // 网络字节序，0为空
+        atomic<uint32_t> conns;   // 当前连接数
+        float tokens;             // 剩余令牌
+        uint32_t last_ms;         // 上次补充令牌的时间
+    };
+
+    ip_limit() : m_table(NULL), m_max_conns(0), m_rate(0), m_burst(0), m_rate_per_ms(0), m_idle_ms(0) {}
+
+    // 粗粒度单调时钟，精度为一个时钟节拍，开销远小于CLOCK_MONOTONIC
+    static inline uint32_t now_ms() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    static inline uint32_t hash(uint32_t ip) {
+        return (ip * 2654435761u) >> 16;
+    }
+
+    // 查找ip对应的表项；create为true时找不到则占用空表项或可复用的表项
+    slot *find(uint32_t ip, bool create);
+
+    slot *m_table;
+    int m_max_conns;
+    int m_rate;
+    float m_burst;
+    float m_rate_per_ms;
+    uint32_t m_idle_ms;      // 令牌桶从空补满所需的时间，超过即可复用
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "sock_profile.h"
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+bool sock_profile::parse(const string &spec) {
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t end = spec.find(',', pos);
+        if (end == string::npos) {
+            end = spec.size();
+        }
+        string item = spec.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty()) {
+            continue;
+        }
+        // 没有=值的选项视为开启
+        string key = item, value = "1";
+        size_t eq = item.find('=');
+        if (eq != string::npos) {
+            key = item.substr(0, eq);
+            value = item.substr(eq + 1);
+        }
+        // 值必须是完整的非负整数，"sndbuf=abc"、"sndbuf=16k"与未知选项一样视为错误
+        char *tail;
+        errno = 0;
+        long v = strtol(value.c_str(), &tail, 10);
+        if (value.empty() || *tail || errno || v < 0 || v > INT_MAX) {
+            return false;
+        }
+        if (key == "nodelay") {
+            nodelay = (int) v;
+        } else if (key == "cork") {
+            cork = (int) v;
+        } else if (key == "sndbuf") {
+            sndbuf = (int) v;
+        } else if (key == "rcvbuf") {
+            rcvbuf = (int) v;
+        } else if (key == "busy_poll") {
+            busy_poll = (int) v;
+        } else if (key == "fastopen") {
+            fastopen = (int) v;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 参数：socket 层级 选项 值 选项名 失败时追加选项名的字符串
+static void set_opt(int fd, int level, int opt, int value, const char *name, bool &ok, string &failed) {
+    if (setsockopt(fd, level, opt, &value, sizeof(value)) < 0) {
+        ok = false;
+        failed += failed.empty() ? name : string(",") + name;
+    }
+}
+
+bool sock_profile::apply_listen(int fd, string &failed) const {
+    bool ok = true;
+    failed.clear();
+    if (nodelay) {
+        set_opt(fd, IPPROTO_TCP, TCP_NODELAY, 1, "nodelay", ok, failed);
+    }
+    if (sndbuf) {
+        set_opt(fd, SOL_SOCKET, SO_SNDBUF, sndbuf, "sndbuf", ok, failed);
+    }
+    if (rcvbuf) {
+        set_opt(fd, SOL_SOCKET, SO_RCVBUF, rcvbuf, "rcvbuf", ok, failed);
+    }
+    if (busy_poll) {
+        set_opt(fd, SOL_SOCKET, SO_BUSY_POLL, busy_poll, "busy_poll", ok, failed);
+    }
+    if (fastopen) {
+        set_opt(fd, IPPROTO_TCP, TCP_FASTOPEN, fastopen, "fastopen", ok, failed);
+    }
+    return ok;
+}
+
+string sock_profile::describe() const {
+    char buf[160];
+    snprintf(buf, sizeof(buf), "nodelay=%d,cork=%d,sndbuf=%d,rcvbuf=%d,busy_poll=%d,fastopen=%d",
+             nodelay, cork, sndbuf, rcvbuf, busy_poll, fastopen);
+    return buf;
+}
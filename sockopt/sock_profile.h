@@ -0,0 +1,37 @@
+/*************************************************************
+*socket调优选项，由-j参数以逗号分隔给出，例如：
+*   -j nodelay,sndbuf=262144,rcvbuf=131072,busy_poll=50,fastopen=256,cork
+*除cork外的选项都设置在监听socket上：accept得到的连接会继承监听socket的
+*TCP_NODELAY、SO_SNDBUF/SO_RCVBUF、SO_BUSY_POLL，每个连接不需要额外的系统调用
+*cork在发送带文件的响应时由http_conn按响应设置和解除
+**************************************************************/
+
+#ifndef SOCK_PROFILE_H
+#define SOCK_PROFILE_H
+
+#include <string>
+
+using namespace std;
+
+struct sock_profile {
+    int nodelay;     // TCP_NODELAY，关闭Nagle算法
+    int cork;        // 发送响应头和文件时加TCP_CORK，发送完毕后解除
+    int sndbuf;      // SO_SNDBUF字节数，0为内核自动调整
+    int rcvbuf;      // SO_RCVBUF字节数，0为内核自动调整
+    int busy_poll;   // SO_BUSY_POLL微秒数，需要网卡驱动支持，设置超过net.core.busy_read需CAP_NET_ADMIN
+    int fastopen;    // 监听socket的TCP_FASTOPEN队列长度，还需要net.ipv4.tcp_fastopen开启服务端
+
+    sock_profile() : nodelay(0), cork(0), sndbuf(0), rcvbuf(0), busy_poll(0), fastopen(0) {}
+
+    // 解析选项串，未知选项或值不是非负整数时返回false
+    bool parse(const string &spec);
+
+    // 在listen之前调用，接收缓冲区须在listen之前设置才能参与窗口扩大因子的协商
+    // 返回false时failed中为设置失败的选项
+    bool apply_listen(int fd, string &failed) const;
+
+    // 生成与parse格式相同的描述，用于日志
+    string describe() const;
+};
+
+#endif
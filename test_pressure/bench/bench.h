@@ -0,0 +1,77 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+// 自包含的微基准工具，不依赖第三方库
+
+// 单调时钟，单位秒
+static inline double bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 防止编译器把被测结果优化掉
+template<typename T>
+static inline void bench_keep(const T &v) {
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+// 输出一行结果：名称、操作数、耗时、单次开销、吞吐
+static inline void bench_report(const char *name, long ops, double secs) {
+    printf("%-40s %12ld ops %9.3f s %10.1f ns/op %10.2f Mops/s\n",
+           name, ops, secs, secs * 1e9 / (ops ? ops : 1), ops / secs / 1e6);
+    fflush(stdout);
+}
+
+// 启动n个线程同时执行fn(arg, idx)，返回从全部就绪到全部结束的耗时
+struct bench_threads {
+    typedef void (*func_t)(void *arg, int idx);
+
+    struct ctx {
+        bench_threads *self;
+        int idx;
+    };
+
+    func_t fn;
+    void *arg;
+    int n;
+    pthread_barrier_t start;
+
+    static void *entry(void *p) {
+        ctx *c = (ctx *) p;
+        pthread_barrier_wait(&c->self->start);
+        c->self->fn(c->self->arg, c->idx);
+        return NULL;
+    }
+
+    double run(func_t f, void *a, int threads) {
+        fn = f;
+        arg = a;
+        n = threads;
+        pthread_barrier_init(&start, NULL, n + 1);
+        pthread_t *tids = new pthread_t[n];
+        ctx *ctxs = new ctx[n];
+        for (int i = 0; i < n; ++i) {
+            ctxs[i].self = this;
+            ctxs[i].idx = i;
+            pthread_create(tids + i, NULL, entry, ctxs + i);
+        }
+        pthread_barrier_wait(&start);
+        double begin = bench_now();
+        for (int i = 0; i < n; ++i) {
+            pthread_join(tids[i], NULL);
+        }
+        double secs = bench_now() - begin;
+        pthread_barrier_destroy(&start);
+        delete[] tids;
+        delete[] ctxs;
+        return secs;
+    }
+};
+
+#endif
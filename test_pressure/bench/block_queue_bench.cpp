@@ -0,0 +1,185 @@
+// 阻塞队列生产者/消费者吞吐：1~8个生产者，1个消费者，元素为一行日志长度的string
+// 对比原来的实现（每次push广播、按值拷贝、逐个pop）与现在的实现（按需signal、移动、逐个pop或pop_all）
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <sched.h>
+#include "bench.h"
+#include "../../log/block_queue.h"
+
+using namespace std;
+
+static const int ITEMS_PER_PRODUCER = 500000;
+static const int QUEUE_SIZE = 800;  // 与异步日志的队列长度一致
+
+// 原来的实现，只保留基准用到的接口
+template<class T>
+class legacy_queue {
+public:
+    legacy_queue(int max_size) {
+        m_max_size = max_size;
+        m_array = new T[max_size];
+        m_size = 0;
+        m_front = -1;
+        m_back = -1;
+    }
+
+    ~legacy_queue() {
+        delete[] m_array;
+    }
+
+    bool push(const T &item) {
+        m_mutex.lock();
+        if (m_size >= m_max_size) {
+            m_cond.broadcast();
+            m_mutex.unlock();
+            return false;
+        }
+        m_back = (m_back + 1) % m_max_size;
+        m_array[m_back] = item;
+        m_size++;
+        m_cond.broadcast();
+        m_mutex.unlock();
+        return true;
+    }
+
+    bool pop(T &item, int ms_timeout) {
+        struct timespec t = {0, 0};
+        struct timeval now = {0, 0};
+        gettimeofday(&now, NULL);
+        m_mutex.lock();
+        if (m_size <= 0) {
+            t.tv_sec = now.tv_sec + ms_timeout / 1000;
+            t.tv_nsec = now.tv_usec * 1000 + (ms_timeout % 1000) * 1000000L;
+            if (t.tv_nsec >= 1000000000L) {
+                t.tv_sec++;
+                t.tv_nsec -= 1000000000L;
+            }
+            if (!m_cond.timewait(m_mutex.get(), t)) {
+                m_mutex.unlock();
+                return false;
+            }
+        }
+        if (m_size <= 0) {
+            m_mutex.unlock();
+            return false;
+        }
+        m_front = (m_front + 1) % m_max_size;
+        item = m_array[m_front];
+        m_size--;
+        m_mutex.unlock();
+        return true;
+    }
+
+private:
+    locker m_mutex;
+    cond m_cond;
+    T *m_array;
+    int m_size;
+    int m_max_size;
+    int m_front;
+    int m_back;
+};
+
+enum consume_mode {
+    POP_ONE,
+    POP_ALL,
+};
+
+template<typename QUEUE>
+struct workload {
+    QUEUE *queue;
+    int producers;
+    consume_mode mode;
+    atomic<long> bytes;
+};
+
+// 旧队列只有拷贝版本的push，新队列用移动版本
+static inline bool produce(legacy_queue<string> *q, string &s) {
+    return q->push(s);
+}
+
+static inline bool produce(block_queue<string> *q, string &s) {
+    return q->push(std::move(s));
+}
+
+static inline int consume(legacy_queue<string> *q, vector<string> &out, consume_mode) {
+    string s;
+    if (!q->pop(s, 10)) {
+        return 0;
+    }
+    out.push_back(s);
+    return 1;
+}
+
+static inline int consume(block_queue<string> *q, vector<string> &out, consume_mode mode) {
+    if (mode == POP_ALL) {
+        return q->pop_all(out, 10);
+    }
+    string s;
+    if (!q->pop(s, 10)) {
+        return 0;
+    }
+    out.push_back(std::move(s));
+    return 1;
+}
+
+template<typename QUEUE>
+static void worker(void *arg, int idx) {
+    workload<QUEUE> *w = (workload<QUEUE> *) arg;
+    if (idx == 0) {
+        // 消费者：取出并累计长度，模拟写文件前的处理
+        long total = (long) w->producers * ITEMS_PER_PRODUCER;
+        long bytes = 0;
+        vector<string> batch;
+        for (long got = 0; got < total;) {
+            batch.clear();
+            got += consume(w->queue, batch, w->mode);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                bytes += batch[i].size();
+            }
+        }
+        w->bytes.store(bytes);
+        return;
+    }
+
+    char line[128];
+    for (int i = 0; i < ITEMS_PER_PRODUCER; ++i) {
+        int n = snprintf(line, sizeof(line), "2024-01-01 00:00:00.000000 [info]: producer %d item %d "
+                                             "request line GET /index.html HTTP/1.1\n", idx, i);
+        string s(line, n);
+        // 队列满时让出CPU重试，不丢数据
+        while (!produce(w->queue, s)) {
+            sched_yield();
+        }
+    }
+}
+
+template<typename QUEUE>
+static void run(const char *label, int producers, consume_mode mode) {
+    QUEUE queue(QUEUE_SIZE);
+    workload<QUEUE> w;
+    w.queue = &queue;
+    w.producers = producers;
+    w.mode = mode;
+    w.bytes.store(0);
+
+    bench_threads bt;
+    double secs = bt.run(worker<QUEUE>, &w, producers + 1);
+
+    char title[64];
+    snprintf(title, sizeof(title), "%s/producers:%d", label, producers);
+    bench_report(title, (long) producers * ITEMS_PER_PRODUCER, secs);
+    bench_keep(w.bytes);
+}
+
+int main() {
+    int producers[] = {1, 4, 8};
+    for (size_t i = 0; i < sizeof(producers) / sizeof(producers[0]); ++i) {
+        run<legacy_queue<string> >("legacy broadcast+copy", producers[i], POP_ONE);
+        run<block_queue<string> >("block_queue pop", producers[i], POP_ONE);
+        run<block_queue<string> >("block_queue pop_all", producers[i], POP_ALL);
+    }
+    return 0;
+}
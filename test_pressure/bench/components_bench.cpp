@@ -0,0 +1,341 @@
+// 热点组件微基准：脱离网络单独测量每个组件，避免端到端压测的噪声
+//   http_conn     parse_line逐行切分、process_read完整解析(GET静态页/POST登录)、响应头生成
+//   sort_timer_lst 不同链表长度下的add/adjust/del
+//   block_queue   单线程push+pop
+//   threadpool    append_p到工作线程开始处理的往返延迟与突发吞吐
+//   Log           同步文本日志write_log吞吐
+//   connection_pool 单线程与多线程的获取/归还
+//   ip_limit      按IP的连接数与令牌桶检查，分别测量少量和大量不同IP
+// 链接数据库桩(mysql_stub.cpp)，需在仓库根目录运行以找到root目录：make bench_components DEBUG=0 && ./bench_components
+
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "../../http/http_conn.h"
+#include "../../threadpool/threadpool.h"
+#include "../../log/block_queue.h"
+
+using namespace std;
+
+static int m_close_log = 0;  // LOG_*宏引用
+
+static const char GET_REQUEST[] =
+        "GET / HTTP/1.1\r\n"
+        "Host: 127.0.0.1:9006\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+
+static const char LOGIN_REQUEST[] =
+        "POST /2CGISQL.cgi HTTP/1.1\r\n"
+        "Host: 127.0.0.1:9006\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Connection: keep-alive\r\n"
+        "Content-Length: 27\r\n"
+        "\r\n"
+        "user=bench7&password=123456";
+
+// 通过友元访问http_conn的私有方法
+class http_conn_bench {
+public:
+    // 只重置解析状态，不像init()那样清空整个缓冲区
+    static void load(http_conn &c, const char *req, size_t len) {
+        memcpy(c.m_read_buf, req, len);
+        c.m_read_buf[len] = '\0';
+        c.m_read_idx = len;
+        c.m_checked_idx = 0;
+        c.m_start_line = 0;
+        c.m_check_state = http_conn::CHECK_STATE_REQUESTLINE;
+        c.m_linger = false;
+        c.m_content_length = 0;
+        c.m_host = 0;
+        c.cgi = 0;
+        c.m_write_idx = 0;
+        c.mysql = NULL;
+    }
+
+    static void setup(http_conn &c, char *root) {
+        c.m_sockfd = -1;
+        c.doc_root = root;
+        c.m_TRIGMode = 0;
+        c.m_close_log = 0;
+        c.m_file_address = 0;
+        c.init();
+    }
+
+    static int split_lines(http_conn &c, const char *req, size_t len) {
+        load(c, req, len);
+        int lines = 0;
+        while (c.parse_line() == http_conn::LINE_OK) {
+            ++lines;
+        }
+        return lines;
+    }
+
+    static int process_read(http_conn &c, const char *req, size_t len) {
+        load(c, req, len);
+        int ret = c.process_read();
+        c.unmap();
+        return ret;
+    }
+
+    static int headers(http_conn &c) {
+        c.m_write_idx = 0;
+        c.m_linger = true;
+        c.add_status_line(200, "OK");
+        c.add_headers(586);
+        return c.m_write_idx;
+    }
+};
+
+static void bench_http() {
+    static http_conn conn;
+    static char root[] = "./root";
+    http_conn_bench::setup(conn, root);
+
+    const long N = 1000000;
+    long sink = 0;
+    double t = bench_now();
+    for (long i = 0; i < N; ++i) {
+        sink += http_conn_bench::split_lines(conn, GET_REQUEST, sizeof(GET_REQUEST) - 1);
+    }
+    bench_report("http_conn parse_line (8 lines)", N, bench_now() - t);
+
+    const long M = 200000;
+    t = bench_now();
+    for (long i = 0; i < M; ++i) {
+        sink += http_conn_bench::process_read(conn, GET_REQUEST, sizeof(GET_REQUEST) - 1);
+    }
+    bench_report("http_conn process_read GET / (stat+mmap)", M, bench_now() - t);
+    if (http_conn_bench::process_read(conn, GET_REQUEST, sizeof(GET_REQUEST) - 1) != http_conn::FILE_REQUEST) {
+        printf("  warning: GET / did not resolve to a file, run from the repository root\n");
+    }
+
+    t = bench_now();
+    for (long i = 0; i < M; ++i) {
+        sink += http_conn_bench::process_read(conn, LOGIN_REQUEST, sizeof(LOGIN_REQUEST) - 1);
+    }
+    bench_report("http_conn process_read POST login", M, bench_now() - t);
+
+    t = bench_now();
+    for (long i = 0; i < N; ++i) {
+        sink += http_conn_bench::headers(conn);
+    }
+    bench_report("http_conn add_status_line+add_headers", N, bench_now() - t);
+    bench_keep(sink);
+}
+
+static void noop_cb(client_data *) {
+}
+
+// 链表长度为size时，依次添加、延长(移到尾部)、删除，模拟连接建立、活动、关闭
+static void bench_timer(int size) {
+    sort_timer_lst lst;
+    vector<util_timer *> timers(size);
+    vector<client_data> users(size);
+    unsigned int seed = 1;
+    time_t base = time(NULL);
+    for (int i = 0; i < size; ++i) {
+        timers[i] = new util_timer;
+        timers[i]->expire = base + rand_r(&seed) % 15;
+        timers[i]->cb_func = noop_cb;
+        timers[i]->user_data = &users[i];
+        users[i].timer = timers[i];
+    }
+
+    double t = bench_now();
+    for (int i = 0; i < size; ++i) {
+        lst.add_timer(timers[i]);
+    }
+    double add = bench_now() - t;
+
+    t = bench_now();
+    for (int i = 0; i < size; ++i) {
+        timers[i]->expire = base + 15 + i;
+        lst.adjust_timer(timers[i]);
+    }
+    double adjust = bench_now() - t;
+
+    t = bench_now();
+    for (int i = 0; i < size; ++i) {
+        lst.del_timer(timers[i]);
+    }
+    double del = bench_now() - t;
+
+    char name[64];
+    snprintf(name, sizeof(name), "sort_timer_lst add/size:%d", size);
+    bench_report(name, size, add);
+    snprintf(name, sizeof(name), "sort_timer_lst adjust/size:%d", size);
+    bench_report(name, size, adjust);
+    snprintf(name, sizeof(name), "sort_timer_lst del/size:%d", size);
+    bench_report(name, size, del);
+}
+
+static void bench_block_queue() {
+    block_queue<string> q(800);
+    const long N = 2000000;
+    string line(100, 'x');
+    long sink = 0;
+    double t = bench_now();
+    for (long i = 0; i < N; ++i) {
+        string s(line);
+        q.push(std::move(s));
+        string out;
+        q.pop(out);
+        sink += out.size();
+    }
+    bench_report("block_queue push+pop (uncontended)", N, bench_now() - t);
+    bench_keep(sink);
+}
+
+// threadpool要求的请求接口
+struct dispatch_task {
+    int m_state;
+    int improv;
+    int timer_flag;
+    double enqueued;
+    double waited;  // 累计入队到开始处理的时间
+    sem *done;
+
+    bool read_once() { return true; }
+
+    bool write() { return true; }
+
+    void process() {
+        waited += bench_now() - enqueued;
+        done->post();
+    }
+
+    void reject_overload() {
+        done->post();
+    }
+};
+
+static void bench_threadpool() {
+    // 工作线程已分离且不会退出，线程池不能随函数返回析构
+    threadpool<dispatch_task> &pool = *new threadpool<dispatch_task>(0, 4, 10000);
+    sem done;
+
+    // 往返：投递后等待工作线程处理完，再投递下一个
+    const int N = 100000;
+    dispatch_task task;
+    task.waited = 0;
+    task.done = &done;
+    double t = bench_now();
+    for (int i = 0; i < N; ++i) {
+        task.enqueued = bench_now();
+        pool.append_p(&task);
+        done.wait();
+    }
+    bench_report("threadpool append_p round trip", N, bench_now() - t);
+    printf("  mean enqueue->process latency %.1f ns\n", task.waited * 1e9 / N);
+
+    // 突发：一次投递一批再等待全部完成
+    const int BATCH = 1000, ROUNDS = 100;
+    vector<dispatch_task> tasks(BATCH);
+    for (int i = 0; i < BATCH; ++i) {
+        tasks[i].waited = 0;
+        tasks[i].done = &done;
+    }
+    t = bench_now();
+    for (int r = 0; r < ROUNDS; ++r) {
+        for (int i = 0; i < BATCH; ++i) {
+            tasks[i].enqueued = bench_now();
+            pool.append_p(&tasks[i]);
+        }
+        for (int i = 0; i < BATCH; ++i) {
+            done.wait();
+        }
+    }
+    bench_report("threadpool append_p burst of 1000", (long) BATCH * ROUNDS, bench_now() - t);
+}
+
+// accept路径：on_connect+on_close；投递请求前：on_request
+static void bench_ip_limit() {
+    ip_limit *limit = ip_limit::get_instance();
+    limit->init(100, 1000000);
+    int counts[] = {16, 20000};
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        const long N = 5000000;
+        unsigned int seed = 1;
+        vector<uint32_t> ips(counts[c]);
+        for (int i = 0; i < counts[c]; ++i) {
+            ips[i] = htonl(0x0a000000 | (rand_r(&seed) & 0xffffff));
+        }
+        long sink = 0;
+        double t = bench_now();
+        for (long i = 0; i < N; ++i) {
+            uint32_t ip = ips[i % counts[c]];
+            sink += limit->on_connect(ip);
+            limit->on_close(ip);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "ip_limit on_connect+on_close/ips:%d", counts[c]);
+        bench_report(name, N, bench_now() - t);
+
+        t = bench_now();
+        for (long i = 0; i < N; ++i) {
+            sink += limit->on_request(ips[i % counts[c]]);
+        }
+        snprintf(name, sizeof(name), "ip_limit on_request/ips:%d", counts[c]);
+        bench_report(name, N, bench_now() - t);
+        bench_keep(sink);
+    }
+}
+
+static void bench_log(const char *path) {
+    Log::get_instance()->init(path, 0, 8192, 5000000, 0);
+    const long N = 1000000;
+    double t = bench_now();
+    for (long i = 0; i < N; ++i) {
+        LOG_INFO("bench line %ld fd %d url %s", i, 12, "/index.html");
+    }
+    Log::get_instance()->flush();
+    bench_report("Log::write_log sync text", N, bench_now() - t);
+}
+
+static void pool_worker(void *arg, int) {
+    connection_pool *pool = (connection_pool *) arg;
+    for (int i = 0; i < 200000; ++i) {
+        MYSQL *con = pool->GetConnection();
+        bench_keep(con);
+        pool->ReleaseConnection(con);
+    }
+}
+
+static void bench_pool(connection_pool *pool) {
+    int threads[] = {1, 4, 16};
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        bench_threads bt;
+        double secs = bt.run(pool_worker, pool, threads[i]);
+        char name[64];
+        snprintf(name, sizeof(name), "connection_pool get+release/threads:%d", threads[i]);
+        bench_report(name, 200000L * threads[i], secs);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *log_path = argc > 1 ? argv[1] : "/tmp/bench_components.log";
+
+    // 日志先初始化，连接池和用户表加载过程中会写日志
+    bench_log(log_path);
+
+    connection_pool *pool = connection_pool::GetInstance();
+    pool->init("localhost", "root", "123456", "webserver", 3306, 8, 0);
+    http_conn loader;
+    loader.initmysql_result(pool, NULL, 0);
+
+    bench_http();
+    int sizes[] = {100, 1000, 10000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        bench_timer(sizes[i]);
+    }
+    bench_block_queue();
+    bench_ip_limit();
+    bench_threadpool();
+    bench_pool(pool);
+    return 0;
+}
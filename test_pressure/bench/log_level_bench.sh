@@ -0,0 +1,42 @@
+#!/bin/bash
+# 不同日志等级下的请求吞吐
+# 依次以 -v 0..3 和 -c 1(关闭日志) 启动服务器，用webbench压测首页，输出每秒请求数
+# 需要在仓库根目录执行，且数据库可用；可通过环境变量调整参数：
+#   PORT=9006 CLIENTS=1000 DURATION=10 LOG_WRITE=0 BINARY=0 ./test_pressure/bench/log_level_bench.sh
+# 另外可用 make server CXXFLAGS="-O2 -DLOG_MIN_LEVEL=2" 编译后再运行，对比编译期过滤的效果
+
+PORT=${PORT:-9006}
+CLIENTS=${CLIENTS:-1000}
+DURATION=${DURATION:-10}
+LOG_WRITE=${LOG_WRITE:-0}
+BINARY=${BINARY:-0}
+WEBBENCH=./test_pressure/webbench-1.5/webbench
+
+if [ ! -x ./server ]; then
+    echo "build the server first: make server DEBUG=0" >&2
+    exit 1
+fi
+if [ ! -x $WEBBENCH ]; then
+    make -C ./test_pressure/webbench-1.5 webbench >/dev/null || exit 1
+fi
+
+# 参数：说明 服务器参数...
+run() {
+    local name=$1
+    shift
+    ./server -p $PORT -l $LOG_WRITE -b $BINARY "$@" >/dev/null 2>&1 &
+    local pid=$!
+    sleep 1
+    local speed
+    speed=$($WEBBENCH -c $CLIENTS -t $DURATION http://127.0.0.1:$PORT/ 2>/dev/null \
+            | sed -n 's/^Speed=\([0-9]*\) pages\/min.*/\1/p')
+    kill $pid
+    wait $pid 2>/dev/null
+    printf "%-12s %12s req/s\n" "$name" $((${speed:-0} / 60))
+}
+
+run debug -v 0
+run info -v 1
+run warn -v 2
+run error -v 3
+run off -c 1
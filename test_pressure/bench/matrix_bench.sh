@@ -0,0 +1,123 @@
+#!/bin/bash
+# 服务器配置矩阵压测，结果带git版本追加到历史文件，便于发现性能回退
+# 对 -m 触发模式 × -a 并发模型 × -t 线程数 × -l 日志写入方式 × -j socket选项 的每个组合启动一次服务器，
+# 依次运行固定场景：
+#   small     首页(judge.html，约600字节)
+#   large     大图片(frame.jpg，约130KB)
+#   login     登录POST，用户名为数据库桩预置的bench0..bench999
+#   idle      保持IDLE个空闲连接的同时压测首页
+# 每个场景输出一行JSON追加到 $OUT/matrix.jsonl，同时追加到 $OUT/matrix.csv
+#
+# 默认使用数据库桩(make server_stubdb)离线运行；STUB_DB=0 时使用 ./server，需要本地MySQL
+# 在仓库根目录执行，可通过环境变量调整：
+#   TRIG="0 3" ACTOR="0 1" THREADS="8" LOGW="0 1" SOCKOPTS="none nodelay cork" SCENARIOS="small large login idle" \
+#   CONNS=100 DURATION=10 WARMUP=2 IDLE=2000 PORT=9006 OUT=./bench_results ./test_pressure/bench/matrix_bench.sh
+
+TRIG=${TRIG:-"0 1 2 3"}
+ACTOR=${ACTOR:-"0 1"}
+THREADS=${THREADS:-"8"}
+LOGW=${LOGW:-"0 1 2"}
+# 每项为-j的参数，多个选项用+连接(结果文件中的值不能含逗号)，none为不设置，如"none nodelay nodelay+cork"
+SOCKOPTS=${SOCKOPTS:-"none"}
+SCENARIOS=${SCENARIOS:-"small large login idle"}
+CONNS=${CONNS:-100}
+DURATION=${DURATION:-10}
+WARMUP=${WARMUP:-2}
+IDLE=${IDLE:-2000}
+PORT=${PORT:-9006}
+OUT=${OUT:-./bench_results}
+STUB_DB=${STUB_DB:-1}
+
+if [ "$STUB_DB" = "1" ]; then
+    SERVER=./server_stubdb
+else
+    SERVER=./server
+fi
+if [ ! -x $SERVER ] || [ ! -x ./loadgen ]; then
+    echo "build first: make ${SERVER#./} loadgen DEBUG=0" >&2
+    exit 1
+fi
+mkdir -p $OUT || exit 1
+
+REV=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+if ! git diff --quiet HEAD 2>/dev/null; then
+    REV=$REV-dirty
+fi
+DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+HOST=$(hostname)
+CPUS=$(nproc)
+
+# 空闲连接数可能超过默认的文件描述符上限
+ulimit -n 65535 2>/dev/null
+
+# 等待服务器开始监听
+wait_port() {
+    for i in $(seq 50); do
+        if (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    return 1
+}
+
+# 参数：场景名，输出该场景的loadgen参数
+scenario_args() {
+    case $1 in
+        small) echo "-g /" ;;
+        large) echo "-g /frame.jpg" ;;
+        login) echo "-m login=1 -U bench -N 1000" ;;
+        idle) echo "-g / -I $IDLE" ;;
+    esac
+}
+
+# 参数：公共字段 loadgen输出的JSON
+record() {
+    local json="{$1,${2#\{}"
+    echo "$json" >> $OUT/matrix.jsonl
+    # JSON中的值不含逗号，按字段顺序直接转为CSV
+    if [ ! -s $OUT/matrix.csv ]; then
+        echo "$json" | sed -e 's/[{}"]//g' -e 's/:[^,]*//g' > $OUT/matrix.csv
+    fi
+    echo "$json" | sed -e 's/[{}]//g' -e 's/"[a-z0-9_]*"://g' -e 's/"//g' >> $OUT/matrix.csv
+}
+
+for trig in $TRIG; do
+for actor in $ACTOR; do
+for threads in $THREADS; do
+for logw in $LOGW; do
+for sockopts in $SOCKOPTS; do
+    jopt=""
+    if [ "$sockopts" != "none" ]; then
+        jopt="-j ${sockopts//+/,}"
+    fi
+    $SERVER -p $PORT -m $trig -a $actor -t $threads -l $logw -u 0 $jopt >/dev/null 2>&1 &
+    pid=$!
+    if ! wait_port; then
+        echo "server failed to start: -m $trig -a $actor -t $threads -l $logw $jopt" >&2
+        kill $pid 2>/dev/null
+        wait $pid 2>/dev/null
+        continue
+    fi
+    for sc in $SCENARIOS; do
+        result=$(./loadgen -p $PORT -c $CONNS -d $DURATION -w $WARMUP -J $(scenario_args $sc))
+        if [ -z "$result" ]; then
+            echo "loadgen failed: $sc" >&2
+            continue
+        fi
+        common="\"rev\":\"$REV\",\"date\":\"$DATE\",\"host\":\"$HOST\",\"cpus\":$CPUS,\"stub_db\":$STUB_DB"
+        common="$common,\"scenario\":\"$sc\",\"trig\":$trig,\"actor\":$actor,\"server_threads\":$threads,\"log_write\":$logw"
+        common="$common,\"sockopts\":\"$sockopts\""
+        record "$common" "$result"
+        printf "%-6s m=%d a=%d t=%-3d l=%d j=%-10s %s\n" $sc $trig $actor $threads $logw $sockopts \
+            "$(echo "$result" | sed -e 's/.*"rps":\([0-9.]*\).*"lat_p99_us":\([0-9]*\).*/\1 req\/s  p99 \2us/')"
+    done
+    kill $pid
+    wait $pid 2>/dev/null
+done
+done
+done
+done
+done
+
+echo "results appended to $OUT/matrix.jsonl and $OUT/matrix.csv (rev $REV)"
@@ -0,0 +1,146 @@
+// 压测用的数据库桩：替代libmysqlclient链接进服务器(make server_stubdb)，不需要MySQL即可运行完整流程
+// 只实现服务器用到的接口：
+//   SELECT username,passwd FROM user / SELECT id,username,passwd FROM user WHERE id > N
+//       返回预置用户 bench0..bench{N-1}，密码123456，数量由环境变量STUB_DB_USERS指定(默认1000)
+//   SELECT passwd FROM user WHERE username='x' 多进程模式下回查用户，只认识预置用户
+//   SELECT GET_LOCK(...)/RELEASE_LOCK(...) 多进程模式下注册加锁，直接返回1
+//   INSERT 直接成功
+// 环境变量STUB_DB_DELAY_US可为每次查询加上固定延迟，模拟数据库往返
+
+#include <mysql/mysql.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct stub_result {
+    vector<string> cells;
+    vector<char *> row;
+    int columns;
+    size_t next;
+};
+
+static long env_long(const char *name, long def) {
+    const char *v = getenv(name);
+    return v ? atol(v) : def;
+}
+
+// 查询与取结果在同一线程内紧接着进行，用线程局部变量传递
+static __thread stub_result *pending = NULL;
+
+extern "C" {
+
+MYSQL *mysql_init(MYSQL *mysql) {
+    return mysql ? mysql : (MYSQL *) calloc(1, sizeof(MYSQL));
+}
+
+MYSQL *mysql_real_connect(MYSQL *mysql, const char *, const char *, const char *, const char *, unsigned int,
+                          const char *, unsigned long) {
+    return mysql;
+}
+
+int mysql_options(MYSQL *, enum mysql_option, const void *) {
+    return 0;
+}
+
+int mysql_ping(MYSQL *) {
+    return 0;
+}
+
+int mysql_query(MYSQL *, const char *q) {
+    static const long delay = env_long("STUB_DB_DELAY_US", 0);
+    if (delay > 0) {
+        usleep(delay);
+    }
+    if (strncasecmp(q, "SELECT", 6) != 0) {
+        return 0;
+    }
+
+    delete pending;
+    pending = new stub_result;
+    pending->next = 0;
+    long users = env_long("STUB_DB_USERS", 1000);
+    if (strstr(q, "_LOCK(")) {
+        pending->columns = 1;
+        pending->cells.push_back("1");
+        return 0;
+    }
+    const char *name = strstr(q, "username='");
+    if (name) {
+        pending->columns = 1;
+        long id = strncmp(name + 10, "bench", 5) == 0 ? atol(name + 15) : -1;
+        if (id >= 0 && id < users) {
+            pending->cells.push_back("123456");
+        }
+        return 0;
+    }
+    bool with_id = strstr(q, "id,") != NULL;
+    pending->columns = with_id ? 3 : 2;
+    long from = 0;
+    const char *gt = strstr(q, "id >");
+    if (gt) {
+        from = atol(gt + 4);
+    }
+    char buf[32];
+    // 用户编号从1开始，对应id列
+    for (long id = from + 1; id <= users; ++id) {
+        if (with_id) {
+            snprintf(buf, sizeof(buf), "%ld", id);
+            pending->cells.push_back(buf);
+        }
+        snprintf(buf, sizeof(buf), "bench%ld", id - 1);
+        pending->cells.push_back(buf);
+        pending->cells.push_back("123456");
+    }
+    return 0;
+}
+
+MYSQL_RES *mysql_store_result(MYSQL *) {
+    stub_result *r = pending;
+    pending = NULL;
+    return (MYSQL_RES *) r;
+}
+
+MYSQL_RES *mysql_use_result(MYSQL *mysql) {
+    return mysql_store_result(mysql);
+}
+
+MYSQL_ROW mysql_fetch_row(MYSQL_RES *res) {
+    stub_result *r = (stub_result *) res;
+    if (!r || r->next >= r->cells.size()) {
+        return NULL;
+    }
+    r->row.resize(r->columns);
+    for (int i = 0; i < r->columns; ++i) {
+        r->row[i] = &r->cells[r->next + i][0];
+    }
+    r->next += r->columns;
+    return &r->row[0];
+}
+
+void mysql_free_result(MYSQL_RES *res) {
+    delete (stub_result *) res;
+}
+
+unsigned long mysql_real_escape_string(MYSQL *, char *to, const char *from, unsigned long length) {
+    memcpy(to, from, length);
+    to[length] = '\0';
+    return length;
+}
+
+const char *mysql_error(MYSQL *) {
+    return "";
+}
+
+unsigned int mysql_errno(MYSQL *) {
+    return 0;
+}
+
+void mysql_close(MYSQL *) {
+}
+
+}
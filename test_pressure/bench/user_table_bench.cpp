@@ -0,0 +1,92 @@
+// 用户表并发基准：8~64个线程混合登录（查找）与注册（插入）
+// 对比原来的 map<string, string>（这里补上读写锁保证正确性）与分片的 user_table
+
+#include <string>
+#include <map>
+#include <atomic>
+#include "bench.h"
+#include "../../CGImysql/user_table.h"
+
+using namespace std;
+
+static const int PRELOAD = 100000;        // 预先注册的用户数
+static const int OPS_PER_THREAD = 200000;  // 每个线程的操作数
+static const int REGISTER_PERCENT = 5;    // 注册请求占比
+
+struct map_table {
+    map<string, string> users;
+    pthread_rwlock_t rw;
+
+    map_table() { pthread_rwlock_init(&rw, NULL); }
+
+    bool verify(const char *name, const char *passwd) {
+        pthread_rwlock_rdlock(&rw);
+        map<string, string>::iterator it = users.find(name);
+        bool ok = it != users.end() && it->second == passwd;
+        pthread_rwlock_unlock(&rw);
+        return ok;
+    }
+
+    bool insert(const char *name, const char *passwd) {
+        pthread_rwlock_wrlock(&rw);
+        bool ok = users.insert(pair<string, string>(name, passwd)).second;
+        pthread_rwlock_unlock(&rw);
+        return ok;
+    }
+};
+
+template<typename TABLE>
+struct workload {
+    TABLE *table;
+    atomic<long> next_id;
+    atomic<long> hits;
+};
+
+template<typename TABLE>
+static void worker(void *arg, int idx) {
+    workload<TABLE> *w = (workload<TABLE> *) arg;
+    unsigned int seed = idx * 7919 + 1;
+    char name[32];
+    long hits = 0;
+    for (int i = 0; i < OPS_PER_THREAD; ++i) {
+        if (rand_r(&seed) % 100 < REGISTER_PERCENT) {
+            snprintf(name, sizeof(name), "user%ld", w->next_id.fetch_add(1));
+            w->table->insert(name, "123456");
+        } else {
+            snprintf(name, sizeof(name), "user%d", rand_r(&seed) % PRELOAD);
+            hits += w->table->verify(name, "123456");
+        }
+    }
+    w->hits.fetch_add(hits);
+}
+
+template<typename TABLE>
+static void run(const char *label, int threads) {
+    TABLE table;
+    char name[32];
+    for (int i = 0; i < PRELOAD; ++i) {
+        snprintf(name, sizeof(name), "user%d", i);
+        table.insert(name, "123456");
+    }
+
+    workload<TABLE> w;
+    w.table = &table;
+    w.next_id.store(PRELOAD);
+    w.hits.store(0);
+
+    bench_threads bt;
+    double secs = bt.run(worker<TABLE>, &w, threads);
+
+    char title[64];
+    snprintf(title, sizeof(title), "%s/threads:%d", label, threads);
+    bench_report(title, (long) threads * OPS_PER_THREAD, secs);
+}
+
+int main() {
+    int threads[] = {8, 16, 32, 64};
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        run<map_table>("map+rwlock", threads[i]);
+        run<user_table>("user_table", threads[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,737 @@
+// 基于epoll的HTTP压测工具，替代webbench
+// 每个线程一个epoll，非阻塞连接，支持keep-alive、流水线、固定速率(开环)与混合请求，
+// 延迟用对数线性直方图统计，输出p50/p90/p99/p99.9
+//
+// 闭环(默认)：每个连接始终保持-P个请求在途，收到响应立即发下一个
+// 开环(-R)：按固定速率计划发送时间，延迟从计划时间算起，服务器变慢时排队时间也计入，避免协调遗漏
+//
+// 示例：
+//   ./loadgen -c 200 -d 30 -k 1                        keep-alive闭环
+//   ./loadgen -c 200 -d 30 -R 20000 -m get=90,login=10  每秒2万请求的开环混合负载
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 对数线性直方图：每个2的幂区间再等分为128份，相对误差小于1%，记录单位为微秒
+class histogram {
+public:
+    static const int SUB_BITS = 8;
+    static const int SUB = 1 << SUB_BITS;
+    static const int HALF = SUB / 2;
+    static const int BUCKETS = SUB + (64 - SUB_BITS) * HALF;
+
+    histogram() : m_counts(BUCKETS, 0), m_total(0), m_sum(0), m_max(0) {}
+
+    void record(uint64_t v) {
+        ++m_counts[index(v)];
+        ++m_total;
+        m_sum += v;
+        if (v > m_max) {
+            m_max = v;
+        }
+    }
+
+    void merge(const histogram &o) {
+        for (int i = 0; i < BUCKETS; ++i) {
+            m_counts[i] += o.m_counts[i];
+        }
+        m_total += o.m_total;
+        m_sum += o.m_sum;
+        if (o.m_max > m_max) {
+            m_max = o.m_max;
+        }
+    }
+
+    // 百分位，返回所在区间的上界
+    uint64_t percentile(double p) const {
+        if (m_total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t) (p / 100.0 * m_total + 0.5);
+        if (rank < 1) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += m_counts[i];
+            if (seen >= rank) {
+                uint64_t v = upper(i);
+                return v < m_max ? v : m_max;
+            }
+        }
+        return m_max;
+    }
+
+    uint64_t total() const { return m_total; }
+
+    double mean() const { return m_total ? (double) m_sum / m_total : 0; }
+
+    uint64_t max() const { return m_max; }
+
+private:
+    static int index(uint64_t v) {
+        if (v < (uint64_t) SUB) {
+            return (int) v;
+        }
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - (SUB_BITS - 1);
+        return SUB + (shift - 1) * HALF + (int) ((v >> shift) - HALF);
+    }
+
+    static uint64_t upper(int i) {
+        if (i < SUB) {
+            return i;
+        }
+        int shift = (i - SUB) / HALF + 1;
+        uint64_t m = (i - SUB) % HALF + HALF;
+        return ((m + 1) << shift) - 1;
+    }
+
+    vector<uint64_t> m_counts;
+    uint64_t m_total;
+    uint64_t m_sum;
+    uint64_t m_max;
+};
+
+enum req_kind {
+    REQ_GET,
+    REQ_LOGIN,
+    REQ_REGISTER,
+    REQ_KINDS,
+};
+
+static const char *KIND_NAMES[REQ_KINDS] = {"get", "login", "register"};
+
+struct options {
+    const char *addr;
+    int port;
+    int conns;
+    int threads;
+    int duration;       // 秒
+    int warmup;         // 秒，不计入统计
+    int keep_alive;
+    int pipeline;       // 每个连接的在途请求数上限
+    double rate;        // 总请求速率，0为闭环
+    int timeout_ms;     // 单个请求的超时
+    int weights[REQ_KINDS];
+    const char *path;   // GET的路径
+    const char *user;   // 登录/注册的用户名前缀
+    const char *passwd;
+    int users;          // 登录时在user0..user{users-1}中随机选择
+    int idle;           // 额外建立的空闲连接数，只连接不发请求
+    int json;
+};
+
+static options opt;
+
+struct request {
+    uint64_t intended;  // 计划发送时间，闭环时等于实际发送时间
+    uint64_t sent;
+    int kind;
+};
+
+struct conn {
+    int fd;
+    bool connecting;
+    string out;
+    size_t out_off;
+    string in;
+    deque<request> inflight;
+    bool want_out;      // 是否已注册EPOLLOUT
+};
+
+struct worker {
+    int id;
+    int epfd;
+    vector<conn> conns;
+    unsigned int seed;
+    long reg_seq;
+
+    uint64_t measure_begin;
+    uint64_t end;
+    uint64_t next_due;  // 开环：下一个计划发送时间
+    uint64_t interval;  // 开环：每个请求的间隔(ns)
+
+    histogram hist;
+    long completed;
+    long errors;
+    long connects;
+    long status[6];     // 按状态码首位统计，0为无法解析
+    long kinds[REQ_KINDS];
+    long bytes;
+    pthread_t tid;
+};
+
+static struct sockaddr_in server_addr;
+
+static void set_events(worker *w, conn &c, bool want_out) {
+    if (c.want_out == want_out) {
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (want_out ? EPOLLOUT : 0);
+    ev.data.u32 = &c - &w->conns[0];
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, c.fd, &ev);
+    c.want_out = want_out;
+}
+
+static void open_conn(worker *w, conn &c) {
+    c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c.connecting = true;
+    c.out.clear();
+    c.out_off = 0;
+    c.in.clear();
+    c.inflight.clear();
+    c.want_out = true;
+    ++w->connects;
+    if (connect(c.fd, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0 && errno != EINPROGRESS) {
+        perror("connect");
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.u32 = &c - &w->conns[0];
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, c.fd, &ev);
+}
+
+// 连接出错或被关闭：在途请求记为错误，重新建连
+static void reset_conn(worker *w, conn &c, uint64_t now) {
+    for (size_t i = 0; i < c.inflight.size(); ++i) {
+        if (c.inflight[i].intended >= w->measure_begin && now < w->end) {
+            ++w->errors;
+        }
+    }
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, c.fd, NULL);
+    close(c.fd);
+    if (now < w->end) {
+        open_conn(w, c);
+    } else {
+        c.fd = -1;
+    }
+}
+
+static int pick_kind(worker *w) {
+    int total = 0;
+    for (int i = 0; i < REQ_KINDS; ++i) {
+        total += opt.weights[i];
+    }
+    int r = rand_r(&w->seed) % total;
+    for (int i = 0; i < REQ_KINDS; ++i) {
+        if (r < opt.weights[i]) {
+            return i;
+        }
+        r -= opt.weights[i];
+    }
+    return REQ_GET;
+}
+
+static void append_request(worker *w, conn &c, int kind) {
+    const char *connection = opt.keep_alive ? "keep-alive" : "close";
+    char buf[512];
+    int n;
+    if (kind == REQ_GET) {
+        n = snprintf(buf, sizeof(buf), "GET %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: %s\r\n\r\n",
+                     opt.path, opt.addr, opt.port, connection);
+    } else {
+        char body[128];
+        int len;
+        if (kind == REQ_LOGIN) {
+            len = snprintf(body, sizeof(body), "user=%s%d&password=%s", opt.user,
+                           rand_r(&w->seed) % (opt.users > 0 ? opt.users : 1), opt.passwd);
+        } else {
+            len = snprintf(body, sizeof(body), "user=%s-%d-%ld-%ld&password=%s", opt.user, w->id,
+                           (long) getpid(), w->reg_seq++, opt.passwd);
+        }
+        n = snprintf(buf, sizeof(buf), "POST /%cCGISQL.cgi HTTP/1.1\r\nHost: %s:%d\r\nConnection: %s\r\n"
+                                       "Content-Type: application/x-www-form-urlencoded\r\n"
+                                       "Content-Length: %d\r\n\r\n%s",
+                     kind == REQ_LOGIN ? '2' : '3', opt.addr, opt.port, connection, len, body);
+    }
+    c.out.append(buf, n);
+}
+
+static void flush_out(worker *w, conn &c, uint64_t now) {
+    while (c.out_off < c.out.size()) {
+        ssize_t n = send(c.fd, c.out.data() + c.out_off, c.out.size() - c.out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                set_events(w, c, true);
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            reset_conn(w, c, now);
+            return;
+        }
+        c.out_off += n;
+    }
+    c.out.clear();
+    c.out_off = 0;
+    set_events(w, c, false);
+}
+
+static void send_request(worker *w, conn &c, uint64_t intended, uint64_t now) {
+    request r;
+    r.intended = intended;
+    r.sent = now;
+    r.kind = pick_kind(w);
+    append_request(w, c, r.kind);
+    c.inflight.push_back(r);
+}
+
+// 不带keep-alive时每个连接只发一个请求
+static int capacity(const conn &c) {
+    if (c.fd < 0 || c.connecting) {
+        return 0;
+    }
+    int depth = opt.keep_alive ? opt.pipeline : 1;
+    return depth - (int) c.inflight.size();
+}
+
+// 在响应头中查找字段，大小写不敏感，值前可以有空格
+static const char *find_header(const char *head, size_t len, const char *name) {
+    size_t nlen = strlen(name);
+    const char *end = head + len;
+    for (const char *p = head; p < end;) {
+        const char *eol = (const char *) memchr(p, '\n', end - p);
+        if (!eol) {
+            break;
+        }
+        if ((size_t) (eol - p) > nlen && strncasecmp(p, name, nlen) == 0) {
+            p += nlen;
+            while (*p == ' ' || *p == '\t') {
+                ++p;
+            }
+            return p;
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+// 解析输入缓冲区中的完整响应，返回false表示连接需要重建
+static bool parse_responses(worker *w, conn &c, uint64_t now) {
+    size_t off = 0;
+    bool close_conn = false;
+    while (!c.inflight.empty()) {
+        const char *base = c.in.data() + off;
+        size_t avail = c.in.size() - off;
+        const char *hend = (const char *) memmem(base, avail, "\r\n\r\n", 4);
+        if (!hend) {
+            break;
+        }
+        size_t head_len = hend - base + 4;
+        const char *cl = find_header(base, head_len, "Content-Length:");
+        size_t body = cl ? strtoul(cl, NULL, 10) : 0;
+        if (avail < head_len + body) {
+            break;
+        }
+
+        int code = 0;
+        if (avail > 12 && strncmp(base, "HTTP/1.", 7) == 0) {
+            code = atoi(base + 9);
+        }
+        const char *conn_hdr = find_header(base, head_len, "Connection:");
+        if (conn_hdr && strncasecmp(conn_hdr, "close", 5) == 0) {
+            close_conn = true;
+        }
+
+        request r = c.inflight.front();
+        c.inflight.pop_front();
+        off += head_len + body;
+        if (r.intended >= w->measure_begin && now < w->end) {
+            w->hist.record((now - r.intended) / 1000);
+            ++w->completed;
+            ++w->kinds[r.kind];
+            ++w->status[code >= 100 && code < 600 ? code / 100 : 0];
+            w->bytes += head_len + body;
+        }
+        if (close_conn) {
+            break;
+        }
+    }
+    c.in.erase(0, off);
+    return !close_conn;
+}
+
+static void handle_read(worker *w, conn &c, uint64_t now) {
+    char buf[65536];
+    while (true) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            c.in.append(buf, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        // 对端关闭或出错，先处理已收到的完整响应
+        parse_responses(w, c, now);
+        reset_conn(w, c, now);
+        return;
+    }
+    if (!parse_responses(w, c, now)) {
+        reset_conn(w, c, now);
+    }
+}
+
+static void fill_closed_loop(worker *w, conn &c, uint64_t now) {
+    int cap = capacity(c);
+    for (int i = 0; i < cap; ++i) {
+        send_request(w, c, now, now);
+    }
+    if (cap > 0) {
+        flush_out(w, c, now);
+    }
+}
+
+// 开环：把所有已到计划时间的请求分给有空位的连接，没有空位时保留计划时间稍后再发
+static void dispatch_open_loop(worker *w, uint64_t now) {
+    size_t n = w->conns.size();
+    static __thread size_t cursor = 0;
+    while (w->next_due <= now && w->next_due < w->end) {
+        size_t tried = 0;
+        while (tried < n && capacity(w->conns[cursor % n]) <= 0) {
+            ++cursor;
+            ++tried;
+        }
+        if (tried == n) {
+            break;
+        }
+        conn &c = w->conns[cursor % n];
+        send_request(w, c, w->next_due, now);
+        flush_out(w, c, now);
+        w->next_due += w->interval;
+        ++cursor;
+    }
+}
+
+static void check_timeouts(worker *w, uint64_t now) {
+    uint64_t limit = (uint64_t) opt.timeout_ms * 1000000ULL;
+    for (size_t i = 0; i < w->conns.size(); ++i) {
+        conn &c = w->conns[i];
+        if (c.fd >= 0 && !c.inflight.empty() && now - c.inflight.front().sent > limit) {
+            reset_conn(w, c, now);
+        }
+    }
+}
+
+static void *run_worker(void *arg) {
+    worker *w = (worker *) arg;
+    w->epfd = epoll_create1(0);
+    for (size_t i = 0; i < w->conns.size(); ++i) {
+        open_conn(w, w->conns[i]);
+    }
+
+    struct epoll_event events[1024];
+    uint64_t last_check = now_ns();
+    while (true) {
+        uint64_t now = now_ns();
+        if (now >= w->end) {
+            break;
+        }
+        int wait_ms = 10;
+        if (opt.rate > 0 && w->next_due > now) {
+            uint64_t ms = (w->next_due - now) / 1000000;
+            wait_ms = ms < 10 ? (int) ms : 10;
+        } else if (opt.rate > 0) {
+            wait_ms = 0;
+        }
+        int n = epoll_wait(w->epfd, events, 1024, wait_ms);
+        now = now_ns();
+        for (int i = 0; i < n; ++i) {
+            conn &c = w->conns[events[i].data.u32];
+            if (c.fd < 0) {
+                continue;
+            }
+            if (c.connecting) {
+                if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0) {
+                        // 服务器未就绪或拒绝连接，稍后重试
+                        usleep(1000);
+                        reset_conn(w, c, now);
+                        continue;
+                    }
+                    c.connecting = false;
+                    set_events(w, c, false);
+                    if (opt.rate <= 0) {
+                        fill_closed_loop(w, c, now);
+                    }
+                }
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                handle_read(w, c, now);
+                if (c.fd < 0 || c.connecting) {
+                    continue;
+                }
+            }
+            if (events[i].events & EPOLLOUT) {
+                flush_out(w, c, now);
+            }
+            if (opt.rate <= 0 && c.fd >= 0) {
+                fill_closed_loop(w, c, now);
+            }
+        }
+        if (opt.rate > 0) {
+            dispatch_open_loop(w, now);
+        }
+        if (now - last_check > 100000000ULL) {
+            check_timeouts(w, now);
+            last_check = now;
+        }
+    }
+    for (size_t i = 0; i < w->conns.size(); ++i) {
+        if (w->conns[i].fd >= 0) {
+            close(w->conns[i].fd);
+        }
+    }
+    close(w->epfd);
+    return NULL;
+}
+
+static bool parse_mix(const char *spec) {
+    for (int i = 0; i < REQ_KINDS; ++i) {
+        opt.weights[i] = 0;
+    }
+    string s(spec);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        string item = s.substr(pos, comma == string::npos ? string::npos : comma - pos);
+        size_t eq = item.find('=');
+        string name = item.substr(0, eq);
+        int weight = eq == string::npos ? 1 : atoi(item.c_str() + eq + 1);
+        int k = 0;
+        while (k < REQ_KINDS && name != KIND_NAMES[k]) {
+            ++k;
+        }
+        if (k == REQ_KINDS || weight < 0) {
+            return false;
+        }
+        opt.weights[k] = weight;
+        if (comma == string::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+    return opt.weights[REQ_GET] + opt.weights[REQ_LOGIN] + opt.weights[REQ_REGISTER] > 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -a addr      server address (127.0.0.1)\n"
+            "  -p port      server port (9006)\n"
+            "  -c conns     connections (100)\n"
+            "  -j threads   worker threads (1)\n"
+            "  -d seconds   measured duration (10)\n"
+            "  -w seconds   warmup, not measured (0)\n"
+            "  -k 0|1       keep-alive (1)\n"
+            "  -P depth     pipelined requests per connection (1)\n"
+            "  -R rate      open-loop total requests/s, 0 for closed loop (0)\n"
+            "  -o ms        request timeout (5000)\n"
+            "  -m mix       request mix, e.g. get=80,login=15,register=5 (get=1)\n"
+            "  -g path      path for GET requests (/)\n"
+            "  -U prefix    user name prefix for login/register (bench)\n"
+            "  -W passwd    password for login/register (123456)\n"
+            "  -N users     login picks prefix0..prefix{N-1} (1000)\n"
+            "  -I idle      extra idle connections held open during the run (0)\n"
+            "  -J           print one JSON line instead of the text report\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    opt.addr = "127.0.0.1";
+    opt.port = 9006;
+    opt.conns = 100;
+    opt.threads = 1;
+    opt.duration = 10;
+    opt.warmup = 0;
+    opt.keep_alive = 1;
+    opt.pipeline = 1;
+    opt.rate = 0;
+    opt.timeout_ms = 5000;
+    parse_mix("get=1");
+    opt.path = "/";
+    opt.user = "bench";
+    opt.passwd = "123456";
+    opt.users = 1000;
+    opt.idle = 0;
+    opt.json = 0;
+
+    int c;
+    while ((c = getopt(argc, argv, "a:p:c:j:d:w:k:P:R:o:m:g:U:W:N:I:Jh")) != -1) {
+        switch (c) {
+            case 'a': opt.addr = optarg; break;
+            case 'p': opt.port = atoi(optarg); break;
+            case 'c': opt.conns = atoi(optarg); break;
+            case 'j': opt.threads = atoi(optarg); break;
+            case 'd': opt.duration = atoi(optarg); break;
+            case 'w': opt.warmup = atoi(optarg); break;
+            case 'k': opt.keep_alive = atoi(optarg); break;
+            case 'P': opt.pipeline = atoi(optarg); break;
+            case 'R': opt.rate = atof(optarg); break;
+            case 'o': opt.timeout_ms = atoi(optarg); break;
+            case 'm':
+                if (!parse_mix(optarg)) {
+                    fprintf(stderr, "bad mix: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'g': opt.path = optarg; break;
+            case 'U': opt.user = optarg; break;
+            case 'W': opt.passwd = optarg; break;
+            case 'N': opt.users = atoi(optarg); break;
+            case 'I': opt.idle = atoi(optarg); break;
+            case 'J': opt.json = 1; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (opt.threads < 1) {
+        opt.threads = 1;
+    }
+    if (opt.conns < opt.threads) {
+        opt.conns = opt.threads;
+    }
+    if (opt.pipeline < 1) {
+        opt.pipeline = 1;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(opt.port);
+    if (inet_pton(AF_INET, opt.addr, &server_addr.sin_addr) != 1) {
+        fprintf(stderr, "bad address: %s\n", opt.addr);
+        return 1;
+    }
+
+    // 空闲连接：占用服务器的连接槽位和定时器，考察大量空闲连接对活跃请求的影响
+    vector<int> idle_fds;
+    for (int i = 0; i < opt.idle; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0) {
+            perror("idle connect");
+            if (fd >= 0) {
+                close(fd);
+            }
+            break;
+        }
+        idle_fds.push_back(fd);
+    }
+
+    uint64_t start = now_ns();
+    uint64_t measure_begin = start + opt.warmup * 1000000000ULL;
+    uint64_t end = measure_begin + opt.duration * 1000000000ULL;
+    vector<worker> workers(opt.threads);
+    for (int i = 0; i < opt.threads; ++i) {
+        worker &w = workers[i];
+        w.id = i;
+        w.conns.resize(opt.conns / opt.threads + (i < opt.conns % opt.threads ? 1 : 0));
+        w.seed = 12345 + i * 7919;
+        w.reg_seq = 0;
+        w.measure_begin = measure_begin;
+        w.end = end;
+        // 各线程平分速率，计划时间错开
+        w.interval = opt.rate > 0 ? (uint64_t) (1e9 * opt.threads / opt.rate) : 0;
+        w.next_due = start + (w.interval ? w.interval * i / opt.threads : 0);
+        w.completed = 0;
+        w.errors = 0;
+        w.connects = 0;
+        w.bytes = 0;
+        memset(w.status, 0, sizeof(w.status));
+        memset(w.kinds, 0, sizeof(w.kinds));
+    }
+    for (int i = 0; i < opt.threads; ++i) {
+        pthread_create(&workers[i].tid, NULL, run_worker, &workers[i]);
+    }
+
+    histogram hist;
+    long completed = 0, errors = 0, connects = 0, bytes = 0;
+    long status[6] = {0}, kinds[REQ_KINDS] = {0};
+    for (int i = 0; i < opt.threads; ++i) {
+        pthread_join(workers[i].tid, NULL);
+        hist.merge(workers[i].hist);
+        completed += workers[i].completed;
+        errors += workers[i].errors;
+        connects += workers[i].connects;
+        bytes += workers[i].bytes;
+        for (int k = 0; k < 6; ++k) {
+            status[k] += workers[i].status[k];
+        }
+        for (int k = 0; k < REQ_KINDS; ++k) {
+            kinds[k] += workers[i].kinds[k];
+        }
+    }
+
+    for (size_t i = 0; i < idle_fds.size(); ++i) {
+        close(idle_fds[i]);
+    }
+
+    double secs = opt.duration > 0 ? opt.duration : 1;
+    if (opt.json) {
+        printf("{\"conns\":%d,\"threads\":%d,\"keep_alive\":%d,\"pipeline\":%d,\"rate\":%.0f,"
+               "\"idle\":%d,\"duration\":%d,\"requests\":%ld,\"errors\":%ld,\"connects\":%ld,\"rps\":%.1f,"
+               "\"bytes_per_sec\":%.0f,\"2xx\":%ld,\"3xx\":%ld,\"4xx\":%ld,\"5xx\":%ld,\"other\":%ld,"
+               "\"lat_mean_us\":%.1f,\"lat_p50_us\":%llu,\"lat_p90_us\":%llu,\"lat_p99_us\":%llu,"
+               "\"lat_p999_us\":%llu,\"lat_max_us\":%llu}\n",
+               opt.conns, opt.threads, opt.keep_alive, opt.pipeline, opt.rate, (int) idle_fds.size(), opt.duration, completed, errors,
+               connects, completed / secs, bytes / secs, status[2], status[3], status[4], status[5],
+               status[0] + status[1], hist.mean(), (unsigned long long) hist.percentile(50),
+               (unsigned long long) hist.percentile(90), (unsigned long long) hist.percentile(99),
+               (unsigned long long) hist.percentile(99.9), (unsigned long long) hist.max());
+        return 0;
+    }
+
+    printf("%s loop, %d connections, %d threads, keep-alive %d, pipeline %d",
+           opt.rate > 0 ? "open" : "closed", opt.conns, opt.threads, opt.keep_alive, opt.pipeline);
+    if (opt.rate > 0) {
+        printf(", target %.0f req/s", opt.rate);
+    }
+    printf("\n");
+    printf("requests   %ld in %ds (%.1f req/s, %.1f KB/s)\n", completed, opt.duration, completed / secs,
+           bytes / secs / 1024);
+    printf("mix        get %ld, login %ld, register %ld\n", kinds[REQ_GET], kinds[REQ_LOGIN], kinds[REQ_REGISTER]);
+    printf("status     2xx %ld, 3xx %ld, 4xx %ld, 5xx %ld, other %ld\n", status[2], status[3], status[4],
+           status[5], status[0] + status[1]);
+    printf("errors     %ld (timeouts and connection resets), connects %ld\n", errors, connects);
+    printf("latency    mean %.0fus  p50 %lluus  p90 %lluus  p99 %lluus  p99.9 %lluus  max %lluus\n",
+           hist.mean(), (unsigned long long) hist.percentile(50), (unsigned long long) hist.percentile(90),
+           (unsigned long long) hist.percentile(99), (unsigned long long) hist.percentile(99.9),
+           (unsigned long long) hist.max());
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*************************************************************
+*过载控制，参考CoDel：看请求在队列中的排队时间(sojourn)而不是队列长度
+*排队时间持续一个观察窗口都高于目标值，说明工作线程处理不过来，进入过载状态：
+*   工作线程对排队超时的读请求直接返回503，主线程暂停accept
+*队列被取空或排队时间回落到目标值以下时退出过载状态
+*所有方法都在线程池的队列锁内调用，过载标志供主线程无锁读取
+**************************************************************/
+
+#ifndef OVERLOAD_H
+#define OVERLOAD_H
+
+#include <stdint.h>
+#include <atomic>
+
+class overload_ctl {
+public:
+    overload_ctl() : m_target_ns(0), m_interval_ns(0), m_first_above(0), m_dropping(false) {}
+
+    // target_ms为目标排队时间，0为关闭；观察窗口取100ms与20倍目标值中的较大者
+    void set_target(int target_ms) {
+        m_target_ns = (uint64_t) target_ms * 1000000ULL;
+        m_interval_ns = m_target_ns * 20 > 100000000ULL ? m_target_ns * 20 : 100000000ULL;
+    }
+
+    // 取出一个请求时调用，返回true表示应当拒绝该请求
+    bool on_dequeue(uint64_t sojourn_ns, uint64_t now_ns, bool queue_empty) {
+        if (0 == m_target_ns) {
+            return false;
+        }
+        if (sojourn_ns < m_target_ns || queue_empty) {
+            // 排队时间回落或积压已清空
+            m_first_above = 0;
+            m_dropping.store(false, std::memory_order_relaxed);
+            return false;
+        }
+        if (0 == m_first_above) {
+            m_first_above = now_ns + m_interval_ns;
+            return false;
+        }
+        if (now_ns >= m_first_above) {
+            m_dropping.store(true, std::memory_order_relaxed);
+        }
+        return m_dropping.load(std::memory_order_relaxed);
+    }
+
+    bool dropping() const {
+        return m_dropping.load(std::memory_order_relaxed);
+    }
+
+private:
+    uint64_t m_target_ns;
+    uint64_t m_interval_ns;
+    uint64_t m_first_above;     // 排队时间首次超过目标值时设定的窗口结束时间
+    std::atomic<bool> m_dropping;
+};
+
+#endif
@@ -5,14 +5,17 @@
 #include <cstdio>
 #include <exception>
 #include <list>
-#include "../CGImysql/sql_connection_pool.h"
+#include <stdint.h>
+#include <atomic>
 #include "../lock/locker.h"
+#include "../metrics/metrics.h"
+#include "overload.h"
 
 template<typename T>
 class threadpool {
 public:
     /*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量*/
-    threadpool(int actor_model, connection_pool *connPool, int thread_number = 8, int max_request = 10000);
+    threadpool(int actor_model, int thread_number = 8, int max_request = 10000);
 
     ~threadpool();
 
@@ -21,6 +24,32 @@ public:
 
     bool append_p(T *request);
 
+    // 请求队列中等待处理的任务数
+    int queue_size() {
+        return m_pending.load(std::memory_order_relaxed);
+    }
+
+    // 工作线程数与线程id，用于绑定CPU
+    int thread_number() {
+        return m_thread_number;
+    }
+
+    pthread_t thread(int i) {
+        return m_threads[i];
+    }
+
+    // 开启基于排队时间的过载控制，target_ms为目标排队时间，0为关闭
+    void set_overload_target(int target_ms) {
+        m_queuelocker.lock();
+        m_overload.set_target(target_ms);
+        m_queuelocker.unlock();
+    }
+
+    // 排队时间持续超标或队列已满，主线程据此暂停accept、直接拒绝新请求
+    bool overloaded() {
+        return m_overload.dropping() || m_pending.load(std::memory_order_relaxed) >= m_max_requests;
+    }
+
 private:
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
     static void *worker(void *arg);
@@ -31,17 +60,23 @@ private:
     int m_thread_number;          // 线程池中的线程数
     int m_max_requests;           // 请求队列中允许的最大请求数
     pthread_t *m_threads;         // 描述线程池的数组，其大小为m_thread_number
-    std::list<T *> m_workqueue;    // 请求队列
+    // 请求及其入队时间
+    struct task {
+        T *request;
+        uint64_t enqueued;
+    };
+    std::list<task> m_workqueue;    // 请求队列
+    std::atomic<int> m_pending;   // 队列长度，供主线程无锁读取
+    overload_ctl m_overload;      // 过载控制，在队列锁内更新
     locker m_queuelocker;         // 保护请求队列的互斥锁
     sem m_queuestat;              // 是否有任务需要处理
-    connection_pool *m_connPool;  // 数据库连接池
     int m_actor_model;            // 模型切换
 };
 
 template<typename T>
-threadpool<T>::threadpool(int actor_model, connection_pool *connPool, int thread_number, int max_requests)
+threadpool<T>::threadpool(int actor_model, int thread_number, int max_requests)
         : m_actor_model(actor_model), m_thread_number(thread_number), m_max_requests(max_requests), m_threads(NULL),
-          m_connPool(connPool) {
+          m_pending(0) {
 
     if (thread_number <= 0 || max_requests <= 0) {
         throw std::exception();
@@ -95,7 +130,9 @@ bool threadpool<T>::append(T *request, int state) {
     request->m_state = state;
 
     // 添加任务  m_workqueue是一个list容器
-    m_workqueue.push_back(request);
+    task t = {request, metrics::now_ns()};
+    m_workqueue.push_back(t);
+    m_pending.store(m_workqueue.size(), std::memory_order_relaxed);
     m_queuelocker.unlock();
 
     // 信号量提醒有任务要处理
@@ -111,7 +148,9 @@ bool threadpool<T>::append_p(T *request) {
         return false;
     }
     // 添加任务
-    m_workqueue.push_back(request);
+    task t = {request, metrics::now_ns()};
+    m_workqueue.push_back(t);
+    m_pending.store(m_workqueue.size(), std::memory_order_relaxed);
     m_queuelocker.unlock();
     // 信号量提醒有任务要处理
     m_queuestat.post();
@@ -141,19 +180,37 @@ void threadpool<T>::run() {
         }
 
         // 从请求队列中取出第一个任务，并将该任务从请求队列中删除
-        T *request = m_workqueue.front();
+        task t = m_workqueue.front();
         m_workqueue.pop_front();
+        m_pending.store(m_workqueue.size(), std::memory_order_relaxed);
+        uint64_t now = metrics::now_ns();
+        bool shed = m_overload.on_dequeue(now - t.enqueued, now, m_workqueue.empty());
         m_queuelocker.unlock();
+        T *request = t.request;
         if (!request) {
             continue;
         }
+        // 过载时排队过久的读请求直接返回503，写请求已有响应，仍然发送
+        if (shed && (0 == m_actor_model || 0 == request->m_state)) {
+            metrics::inc(M_SHED_SOJOURN);
+            if (1 == m_actor_model) {
+                if (request->read_once()) {
+                    request->reject_overload();
+                } else {
+                    request->timer_flag = 1;
+                }
+                request->improv = 1;
+            } else {
+                request->reject_overload();
+            }
+            continue;
+        }
         // m_actor_model 模型切换？
         if (1 == m_actor_model) {
             if (0 == request->m_state) {
                 if (request->read_once()) {
                     // 只读
                     request->improv = 1;
-                    connectionRAII mysqlcon(&request->mysql, m_connPool);
                     request->process();
                 } else {
                     request->improv = 1;
@@ -168,8 +225,7 @@ void threadpool<T>::run() {
                 }
             }
         } else {
-            // 创建数据库对象
-            connectionRAII mysqlcon(&request->mysql, m_connPool);
+            // 数据库连接由需要访问数据库的处理函数按需获取，这里不再为每个请求借用
             // 调用模板类中的方法进行处理，这里是http类
             // 这里没有搞懂process的过程？
             request->process();
@@ -121,6 +121,7 @@ void sort_timer_lst::tick() {
         }
         // 若当前定时器到期，则调用回调函数，执行定时事件
         tmp->cb_func(tmp->user_data);
+        metrics::inc(M_TIMER_EXPIRED);
         // 将处理后的定时器从链表容器中删除，并重置头节点
         head = tmp->next;
         if (head) {
@@ -242,6 +243,56 @@ void Utils::show_error(int connfd, const char *info) {
     close(connfd);
 }
 
+bool Utils::send_fd(int sock, int fd, int data) {
+    struct iovec iov = {&data, sizeof(data)};
+    // 控制消息缓冲区须按cmsghdr对齐
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t) sizeof(data);
+}
+
+int Utils::recv_fd(int sock, int *data) {
+    struct iovec iov = {data, sizeof(*data)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != (ssize_t) sizeof(*data)) {
+        return -1;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
 int *Utils::u_pipefd = 0;
 int Utils::u_epollfd = 0;
 
@@ -257,4 +308,5 @@ void cb_func(client_data *user_data) {
     close(user_data->sockfd);
     // 减少连接数
     http_conn::m_user_count--;
+    ip_limit::get_instance()->on_close(user_data->address.sin_addr.s_addr);
 }
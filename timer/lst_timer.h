@@ -108,6 +108,11 @@ public:
 
     void show_error(int connfd, const char *info);
 
+    //通过UNIX socket发送、接收文件描述符(SCM_RIGHTS)，附带一个整数
+    static bool send_fd(int sock, int fd, int data);
+
+    static int recv_fd(int sock, int *data);
+
 public:
     static int *u_pipefd;
     sort_timer_lst m_timer_lst;  // 创建定时器容器链表
@@ -18,6 +18,8 @@ WebServer::WebServer() {
 }
 
 WebServer::~WebServer() {
+    // 写快照的线程还在读用户表时不能进入静态析构
+    http_conn::wait_snapshot();
     close(m_epollfd);
     close(m_listenfd);
     close(m_pipefd[1]);
@@ -28,18 +30,48 @@ WebServer::~WebServer() {
 }
 
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write,
-                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model) {
+                     int opt_linger, int trigmode, int sql_num, int sql_min_num, int thread_num, int close_log,
+                     int actor_model, int user_snapshot, int sql_mode, int log_binary, int log_level,
+                     int log_split_mb, int log_gzip, int metrics_port, int slow_ms, int overload_ms,
+                     int ip_conns, int ip_rate, string loop_cpus, string worker_cpus, string log_cpus,
+                     string sock_opts, string handoff_path,
+                     int processes, int stats, string cache_control) {
     m_port = port;
     m_user = user;
     m_passWord = passWord;
     m_databaseName = databaseName;
     m_sql_num = sql_num;
+    m_sql_min_num = sql_min_num;
+    m_sql_mode = sql_mode;
     m_thread_num = thread_num;
     m_log_write = log_write;
+    m_log_binary = log_binary;
+    m_log_level = log_level;
+    m_log_split_mb = log_split_mb;
+    m_log_gzip = log_gzip;
     m_OPT_LINGER = opt_linger;
     m_TRIGMode = trigmode;
     m_close_log = close_log;
     m_actormodel = actor_model;
+    m_user_snapshot = user_snapshot;
+    m_metrics_port = metrics_port;
+    m_slow_ms = slow_ms;
+    m_overload_ms = overload_ms;
+    m_ip_conns = ip_conns;
+    m_ip_rate = ip_rate;
+    m_loop_cpus = loop_cpus;
+    m_worker_cpus = worker_cpus;
+    m_log_cpus = log_cpus;
+    m_sock_opts = sock_opts;
+    m_handoff_path = handoff_path;
+    m_handoff_fd = -1;
+    m_draining = false;
+    m_processes = processes;
+    m_worker_id = -1;
+    m_stats = stats;
+    m_cache_control = cache_control;
+    m_listenfd = -1;
+    m_accept_paused = false;
 }
 
 void WebServer::trig_mode() {
@@ -67,29 +99,93 @@ void WebServer::trig_mode() {
 
 void WebServer::log_write() {
     if (0 == m_close_log) {
+        Log::set_level(m_log_level);
+        Log::get_instance()->set_rotate_policy((long long) m_log_split_mb << 20, 1 == m_log_gzip);
         // 初始化日志
+        // 二进制日志使用单独的文件名，避免与文本日志追加到同一文件
+        bool binary = 1 == m_log_binary;
+        char name[64];
+        snprintf(name, sizeof(name), "%s", binary ? "./ServerLog.bin" : "./ServerLog");
+        // 多进程模式下每个工作进程写自己的日志文件
+        if (m_worker_id >= 0) {
+            snprintf(name, sizeof(name), "%s_w%d%s", "./ServerLog", m_worker_id, binary ? ".bin" : "");
+        }
         if (1 == m_log_write)
-            Log::get_instance()->init("./ServerLog", m_close_log, 2000, 800000, 800);
+            Log::get_instance()->init(name, m_close_log, 2000, 800000, 800, 0, binary);
+        else if (2 == m_log_write)
+            Log::get_instance()->init(name, m_close_log, 2000, 800000, 0, 1 << 20, binary);
         else
-            Log::get_instance()->init("./ServerLog", m_close_log, 2000, 800000, 0);
+            Log::get_instance()->init(name, m_close_log, 2000, 800000, 0, 0, binary);
     }
 }
 
 void WebServer::sql_pool() {
+    // 工作线程独占连接时每个线程都要占一条，连接池上限不能少于线程数
+    if (1 == m_sql_mode && m_sql_num < m_thread_num) {
+        LOG_WARN("sql_num %d < thread_num %d with sticky connections, raised to %d", m_sql_num, m_thread_num,
+                 m_thread_num);
+        m_sql_num = m_thread_num;
+    }
+
     // 初始化数据库连接池
     m_connPool = connection_pool::GetInstance();
-    m_connPool->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log);
+    m_connPool->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log,
+                     m_sql_min_num);
 
-    // 初始化数据库读取表
-    users->initmysql_result(m_connPool);
+    // 处理请求时按需获取连接的方式
+    http_conn::m_connPool = m_connPool;
+    http_conn::m_sql_mode = m_sql_mode;
+    http_conn::m_prefork = m_worker_id >= 0;
+
+    // 初始化数据库读取表，启用快照时先映射快照再从数据库追平增量
+    users->initmysql_result(m_connPool, m_user_snapshot ? "./UserSnapshot" : NULL, m_close_log);
 }
 
 void WebServer::thread_pool() {
     // 线程池
-    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+    m_pool = new threadpool<http_conn>(m_actormodel, m_thread_num);
+    m_pool->set_overload_target(m_overload_ms);
 }
 
-void WebServer::eventListen() {
+// 指标采集时读取的瞬时值
+static long active_connections(void *) {
+    return http_conn::m_user_count.load();
+}
+
+static long threadpool_depth(void *pool) {
+    return ((threadpool<http_conn> *) pool)->queue_size();
+}
+
+static long log_depth(void *) {
+    return Log::get_instance()->queue_size();
+}
+
+static long db_pool_free(void *pool) {
+    return ((connection_pool *) pool)->GetFreeConn();
+}
+
+// 共享内存统计段的内容，由统计线程定期读取，不经过主线程
+static void fill_stats(stats_values &v, void *arg) {
+    WebServer *server = (WebServer *) arg;
+    unsigned long c[M_COUNTER_NUM];
+    metrics::totals(c);
+    v.connections = http_conn::m_user_count.load();
+    v.queue_depth = server->m_pool->queue_size();
+    v.db_used = server->m_connPool->GetCurConn();
+    v.db_open = v.db_used + server->m_connPool->GetFreeConn();
+    v.log_backlog = Log::get_instance()->queue_size();
+    // 不计NO_REQUEST，即请求还没读完的情况
+    for (int i = 1; i < M_REQUEST_CODES; ++i) {
+        v.requests += c[M_REQUESTS + i];
+    }
+    v.accepts = c[M_ACCEPTS];
+    v.bytes_sent = c[M_BYTES_SENT];
+    v.shed = c[M_ACCEPT_REJECTED] + c[M_SHED_ADMISSION] + c[M_SHED_SOJOURN];
+    v.limited = c[M_IP_CONN_LIMITED] + c[M_IP_RATE_LIMITED];
+    v.accept_pauses = c[M_ACCEPT_PAUSED];
+}
+
+void WebServer::create_listenfd(const sock_profile &profile, string &failed) {
     // 网络编程基础步骤
     m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
     assert(m_listenfd >= 0);
@@ -103,7 +199,6 @@ void WebServer::eventListen() {
         setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
 
-    int ret = 0;
     struct sockaddr_in address;
     bzero(&address, sizeof(address));
     address.sin_family = AF_INET;
@@ -112,11 +207,152 @@ void WebServer::eventListen() {
 
     int flag = 1;
     setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
-    ret = bind(m_listenfd, (struct sockaddr *) &address, sizeof(address));
+    // 连接收到数据后才唤醒accept，只握手不发请求的连接不占用主线程
+    int defer = DEFER_ACCEPT_SECONDS;
+    setsockopt(m_listenfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(defer));
+
+    // socket调优选项设置在监听socket上，由accept得到的连接继承
+    // 多进程模式下master不初始化日志，设置失败的选项由调用者输出
+    profile.apply_listen(m_listenfd, failed);
+    int ret = bind(m_listenfd, (struct sockaddr *) &address, sizeof(address));
     assert(ret >= 0);
     ret = listen(m_listenfd, 5);
     assert(ret >= 0);
+}
+
+static volatile sig_atomic_t s_master_stop = 0;
 
+static void master_sig_handler(int) {
+    s_master_stop = 1;
+}
+
+// master只负责创建监听socket、fork和重启工作进程，不初始化日志、数据库和线程池：
+// fork只复制调用线程，必须在任何线程创建之前fork
+void WebServer::prefork() {
+    if (m_processes <= 0) {
+        return;
+    }
+    if (!m_handoff_path.empty()) {
+        printf("hot restart (-i) is not supported with -h, ignored\n");
+        m_handoff_path.clear();
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);  // master的输出重定向到文件时也及时写出
+    sock_profile profile;
+    profile.parse(m_sock_opts);
+    string failed;
+    create_listenfd(profile, failed);
+    if (!failed.empty()) {
+        printf("set socket options failed: %s\n", failed.c_str());
+    }
+    utils.setnonblocking(m_listenfd);
+    // 统计段只在这里初始化一次，工作进程只写各自的槽位
+    if (1 == m_stats && !stats_shm::create(m_port)) {
+        printf("create stats segment %s failed: %s\n", stats_shm::name(m_port).c_str(), strerror(errno));
+    }
+
+    utils.addsig(SIGTERM, master_sig_handler, false);
+    utils.addsig(SIGINT, master_sig_handler, false);
+    utils.addsig(SIGPIPE, SIG_IGN);
+
+    vector<pid_t> pids(m_processes, 0);
+    vector<time_t> started(m_processes, 0);
+    int next = 0;  // 下一个需要启动的工作进程
+    while (!s_master_stop) {
+        if (next < m_processes) {
+            // 刚启动就退出的进程隔一秒再重启，避免反复崩溃时占满CPU
+            if (started[next] && time(NULL) - started[next] < 1) {
+                sleep(1);
+            }
+            fflush(stdout);  // 避免未输出的缓冲区被复制到子进程
+            pid_t pid = fork();
+            if (pid == 0) {
+                // 工作进程：恢复默认信号处理，返回main继续初始化
+                utils.addsig(SIGTERM, SIG_DFL);
+                utils.addsig(SIGINT, SIG_DFL);
+                m_worker_id = next;
+                return;
+            }
+            if (pid < 0) {
+                perror("fork");
+                sleep(1);
+                continue;
+            }
+            printf("worker %d started, pid %d\n", next, (int) pid);
+            pids[next] = pid;
+            started[next] = time(NULL);
+            // 找下一个空位
+            while (next < m_processes && pids[next]) {
+                ++next;
+            }
+            continue;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            continue;  // 被信号打断
+        }
+        for (int i = 0; i < m_processes; ++i) {
+            if (pids[i] == pid) {
+                if (WIFSIGNALED(status)) {
+                    printf("worker %d (pid %d) killed by signal %d, restarting\n", i, (int) pid, WTERMSIG(status));
+                } else {
+                    printf("worker %d (pid %d) exited with %d, restarting\n", i, (int) pid, WEXITSTATUS(status));
+                }
+                pids[i] = 0;
+                next = i < next ? i : next;
+            }
+        }
+    }
+
+    // 通知工作进程退出并等待
+    for (int i = 0; i < m_processes; ++i) {
+        if (pids[i]) {
+            kill(pids[i], SIGTERM);
+        }
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+    }
+    exit(0);
+}
+
+// 多进程模式下各工作进程共享监听socket，EPOLLEXCLUSIVE避免一个连接唤醒所有进程
+void WebServer::add_listenfd() {
+    if (m_worker_id < 0) {
+        utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
+        return;
+    }
+    epoll_event event;
+    event.data.fd = m_listenfd;
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    if (1 == m_LISTENTrigmode) {
+        event.events |= EPOLLET;
+    }
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_listenfd, &event);
+}
+
+void WebServer::eventListen() {
+    sock_profile profile;
+    if (!profile.parse(m_sock_opts)) {
+        LOG_ERROR("invalid socket options: %s", m_sock_opts.c_str());
+        profile = sock_profile();
+    }
+    http_conn::m_cork = profile.cork;
+    if (!http_conn::set_cache_rules(m_cache_control)) {
+        LOG_ERROR("invalid cache control rules: %s", m_cache_control.c_str());
+    }
+
+    // 热重启时从旧进程接收监听socket，socket选项已由旧进程设置；多进程模式下已由master创建
+    if (m_listenfd < 0 && !inherit_listenfd()) {
+        string failed;
+        create_listenfd(profile, failed);
+        if (!failed.empty()) {
+            LOG_ERROR("set socket options failed: %s", failed.c_str());
+        }
+    }
+    LOG_INFO("socket options: %s", profile.describe().c_str());
+
+    int ret = 0;
     utils.init(TIMESLOT);
 
     // epoll创建内核事件表
@@ -125,9 +361,11 @@ void WebServer::eventListen() {
     assert(m_epollfd != -1);
 
     // 將m_listenfd放在epoll树上
-    utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
+    add_listenfd();
     // 将上述m_epollfd赋值给http类对象的m_epollfd属性
     http_conn::m_epollfd = m_epollfd;
+    http_conn::m_slow_ms = m_slow_ms;
+    ip_limit::get_instance()->init(m_ip_conns, m_ip_rate);
 
     /**
      * 在Linux下，使用socketpair函数能够创建一对套接字进行通信，项目中使用管道通信
@@ -154,6 +392,9 @@ void WebServer::eventListen() {
     // 传递给主循环的信号量，这里只关注SIGALRM和SIGTERM
     utils.addsig(SIGALRM, utils.sig_handler, false);
     utils.addsig(SIGTERM, utils.sig_handler, false);
+    // SIGUSR1/SIGUSR2在运行时降低/提高日志等级阈值
+    utils.addsig(SIGUSR1, utils.sig_handler, false);
+    utils.addsig(SIGUSR2, utils.sig_handler, false);
 
     // 每隔TIMESLOT事件出发SIGALRM信号
     alarm(TIMESLOT);
@@ -161,6 +402,171 @@ void WebServer::eventListen() {
     // 工具类,信号和描述符基础操作
     Utils::u_pipefd = m_pipefd;
     Utils::u_epollfd = m_epollfd;
+
+    // 等待下一次热重启的新进程
+    handoff_listen();
+
+    // 运行指标，瞬时值在采集时读取
+    metrics::add_gauge("tinyweb_connections_active", "Open client connections.", active_connections, NULL);
+    metrics::add_gauge("tinyweb_threadpool_queue_depth", "Requests waiting in the thread pool queue.",
+                       threadpool_depth, m_pool);
+    metrics::add_gauge("tinyweb_log_queue_depth", "Log lines waiting in the async log queue.", log_depth, NULL);
+    metrics::add_gauge("tinyweb_db_pool_free", "Idle database connections.", db_pool_free, m_connPool);
+    // 多进程模式下第i个工作进程的管理端口为metrics_port+i
+    metrics::start(m_metrics_port > 0 && m_worker_id > 0 ? m_metrics_port + m_worker_id : m_metrics_port, m_close_log);
+
+    // 共享内存统计段，tinytop读取；多进程模式下各工作进程写自己的槽位
+    // 多进程模式下段已由master创建
+    if (1 == m_stats && m_worker_id < 0 && !stats_shm::create(m_port)) {
+        LOG_ERROR("create stats segment %s failed: %d", stats_shm::name(m_port).c_str(), errno);
+    }
+    if (1 == m_stats && !stats_shm::start(m_port, m_worker_id, fill_stats, this)) {
+        LOG_ERROR("stats segment %s unavailable: %d", stats_shm::name(m_port).c_str(), errno);
+    }
+}
+
+// 连接旧进程的交接socket并接收监听socket，没有旧进程时返回false
+bool WebServer::inherit_listenfd() {
+    if (m_handoff_path.empty()) {
+        return false;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return false;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, m_handoff_path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(sock);
+        return false;
+    }
+    // 旧进程卡住时不要一直等下去
+    struct timeval tv = {5, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int port = 0;
+    int fd = Utils::recv_fd(sock, &port);
+    close(sock);
+    if (fd < 0) {
+        LOG_ERROR("receive listen socket from %s failed:%d", m_handoff_path.c_str(), errno);
+        return false;
+    }
+    if (port != m_port) {
+        LOG_WARN("inherited listen socket is on port %d, not %d", port, m_port);
+    }
+    m_listenfd = fd;
+    LOG_INFO("inherited listen socket on port %d from %s", port, m_handoff_path.c_str());
+    return true;
+}
+
+// 在交接路径上监听，旧进程的socket文件已无人监听，先删除再绑定
+void WebServer::handoff_listen() {
+    if (m_handoff_path.empty()) {
+        return;
+    }
+    m_handoff_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_handoff_fd < 0) {
+        LOG_ERROR("handoff socket error:%d", errno);
+        return;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, m_handoff_path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(m_handoff_path.c_str());
+    if (bind(m_handoff_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(m_handoff_fd, 1) < 0) {
+        LOG_ERROR("handoff listen on %s failed:%d", m_handoff_path.c_str(), errno);
+        close(m_handoff_fd);
+        m_handoff_fd = -1;
+        return;
+    }
+    utils.addfd(m_epollfd, m_handoff_fd, false, 0);
+}
+
+// 新进程连上交接socket：发送监听socket，然后开始排空
+void WebServer::deal_handoff() {
+    int sock = accept4(m_handoff_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (sock < 0) {
+        return;
+    }
+    bool sent = Utils::send_fd(sock, m_listenfd, m_port);
+    close(sock);
+    if (!sent) {
+        LOG_ERROR("send listen socket failed:%d", errno);
+        return;
+    }
+    LOG_INFO("listen socket handed off via %s", m_handoff_path.c_str());
+    start_drain();
+}
+
+// 停止accept，之后的响应都带Connection: close；空闲的长连接由定时器关闭
+// 连接全部关闭或超过DRAIN_SECONDS后主循环退出
+// 两个监听描述符在本轮事件处理完后才关闭，避免同一轮中的事件被当成客户连接
+void WebServer::start_drain() {
+    epoll_ctl(m_epollfd, EPOLL_CTL_DEL, m_listenfd, NULL);
+    epoll_ctl(m_epollfd, EPOLL_CTL_DEL, m_handoff_fd, NULL);
+
+    m_draining = true;
+    http_conn::m_draining = true;
+    stats_shm::stop();  // 统计槽位交给新进程
+    metrics::stop();    // 管理端口交给新进程，避免采集请求在新旧进程间轮流
+    m_drain_deadline = time(NULL) + DRAIN_SECONDS;
+    LOG_INFO("draining %d connections", http_conn::m_user_count.load());
+}
+
+// 绑定CPU，在线程池、日志线程创建之后调用，主线程最后绑定，避免之前创建的线程继承主线程的绑定
+bool WebServer::resolve_cpus(const string &spec, vector<int> &cpus) {
+    if (!affinity::resolve(spec, cpus)) {
+        return false;
+    }
+    // 各工作进程使用同一组-x/-y/-z参数，按进程编号划分，避免所有进程挤在相同的CPU上
+    if (m_worker_id >= 0) {
+        affinity::partition(cpus, m_worker_id, m_processes);
+    }
+    return true;
+}
+
+void WebServer::cpu_affinity() {
+    vector<int> cpus;
+    if (!m_worker_cpus.empty()) {
+        if (!resolve_cpus(m_worker_cpus, cpus)) {
+            LOG_ERROR("invalid worker cpus: %s", m_worker_cpus.c_str());
+        } else {
+            // 每个工作线程绑定一个CPU，线程数多于CPU数时轮流分配
+            for (int i = 0; i < m_pool->thread_number(); ++i) {
+                vector<int> one(1, cpus[i % cpus.size()]);
+                if (affinity::pin(m_pool->thread(i), one)) {
+                    LOG_INFO("worker %d pinned to cpu %d (node %d)", i, one[0], affinity::node_of(one[0]));
+                } else {
+                    LOG_ERROR("pin worker %d to cpu %d failed", i, one[0]);
+                }
+            }
+        }
+    }
+    if (!m_log_cpus.empty()) {
+        vector<pthread_t> tids;
+        Log::get_instance()->background_threads(tids);
+        if (!resolve_cpus(m_log_cpus, cpus)) {
+            LOG_ERROR("invalid log cpus: %s", m_log_cpus.c_str());
+        } else {
+            for (size_t i = 0; i < tids.size(); ++i) {
+                if (!affinity::pin(tids[i], cpus)) {
+                    LOG_ERROR("%s", "pin log thread failed");
+                }
+            }
+            LOG_INFO("log threads pinned to %s", affinity::format(cpus).c_str());
+        }
+    }
+    if (!m_loop_cpus.empty()) {
+        if (!resolve_cpus(m_loop_cpus, cpus)) {
+            LOG_ERROR("invalid event loop cpus: %s", m_loop_cpus.c_str());
+        } else if (affinity::pin(pthread_self(), cpus)) {
+            LOG_INFO("event loop pinned to %s (node %d)", affinity::format(cpus).c_str(), affinity::node_of(cpus[0]));
+        } else {
+            LOG_ERROR("%s", "pin event loop failed");
+        }
+    }
 }
 
 void WebServer::timer(int connfd, struct sockaddr_in client_address) {
@@ -194,7 +600,7 @@ void WebServer::adjust_timer(util_timer *timer) {
     timer->expire = cur + 3 * TIMESLOT;
     utils.m_timer_lst.adjust_timer(timer);
 
-    LOG_INFO("%s", "adjust timer once");
+    LOG_DEBUG("%s", "adjust timer once");
 }
 
 void WebServer::deal_timer(util_timer *timer, int sockfd) {
@@ -205,41 +611,81 @@ void WebServer::deal_timer(util_timer *timer, int sockfd) {
         utils.m_timer_lst.del_timer(timer);
     }
 
-    LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
+    LOG_DEBUG("close fd %d", users_timer[sockfd].sockfd);
+}
+
+// accept后直接拒绝连接时发送的完整响应，只生成一次
+static const char *reject_response(char *buf, size_t size, const char *status, const char *body) {
+    if (!buf[0]) {
+        snprintf(buf, size, "HTTP/1.1 %s\r\nRetry-After:%d\r\nContent-Length:%d\r\nConnection:close\r\n\r\n%s",
+                 status, http_conn::RETRY_AFTER, (int) strlen(body), body);
+    }
+    return buf;
+}
+
+// 连接数达到上限
+static const char *busy_response() {
+    static char buf[256];
+    return reject_response(buf, sizeof(buf), "503 Service Unavailable", "Too many connections, please retry later.\n");
+}
+
+// 单个IP的连接数达到上限
+static const char *ip_limited_response() {
+    static char buf[256];
+    return reject_response(buf, sizeof(buf), "429 Too Many Requests",
+                           "Too many connections from your address, please retry later.\n");
+}
+
+// 过载时暂停accept：把监听socket移出epoll，新连接留在内核的等待队列中，恢复后再加回
+void WebServer::check_overload() {
+    if (m_draining) {
+        return;  // 监听socket已交出
+    }
+    bool busy = m_pool->overloaded();
+    if (busy && !m_accept_paused) {
+        epoll_ctl(m_epollfd, EPOLL_CTL_DEL, m_listenfd, NULL);
+        m_accept_paused = true;
+        metrics::inc(M_ACCEPT_PAUSED);
+        LOG_WARN("%s", "overloaded, accept paused");
+    } else if (!busy && m_accept_paused) {
+        add_listenfd();
+        m_accept_paused = false;
+        LOG_WARN("%s", "overload cleared, accept resumed");
+    }
 }
 
 // http 处理用户连接，为有效连接初始化定时器进行后续操作
 bool WebServer::dealclinetdata() {
-    struct sockaddr_in client_address;
-    socklen_t client_addrlength = sizeof(client_address);
-    if (0 == m_LISTENTrigmode) {
-        int connfd = accept(m_listenfd, (struct sockaddr *) &client_address, &client_addrlength);
+    // LT模式每次事件最多accept ACCEPT_BATCH个，剩下的连接下次epoll_wait仍会通知；ET模式必须取到EAGAIN
+    int batch = 0 == m_LISTENTrigmode ? ACCEPT_BATCH : MAX_FD;
+    for (int i = 0; i < batch; ++i) {
+        struct sockaddr_in client_address;
+        socklen_t client_addrlength = sizeof(client_address);
+        // accept4直接得到非阻塞的连接，省去两次fcntl
+        int connfd = accept4(m_listenfd, (struct sockaddr *) &client_address, &client_addrlength,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (connfd < 0) {
-            LOG_ERROR("%s:errno is:%d", "accept error", errno);
-            return false;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("%s:errno is:%d", "accept error", errno);
+            }
+            break;
         }
         if (http_conn::m_user_count >= MAX_FD) {
-            utils.show_error(connfd, "Internal server busy");
+            utils.show_error(connfd, busy_response());
             LOG_ERROR("%s", "Internal server busy");
-            return false;
+            metrics::inc(M_ACCEPT_REJECTED);
+            continue;
         }
-        timer(connfd, client_address);
-    } else {
-        while (1) {
-            int connfd = accept(m_listenfd, (struct sockaddr *) &client_address, &client_addrlength);
-            if (connfd < 0) {
-                LOG_ERROR("%s:errno is:%d", "accept error", errno);
-                break;
-            }
-            if (http_conn::m_user_count >= MAX_FD) {
-                utils.show_error(connfd, "Internal server busy");
-                LOG_ERROR("%s", "Internal server busy");
-                break;
-            }
-            // 在这里初始化计时器对象
-            timer(connfd, client_address);
+        if (!ip_limit::get_instance()->on_connect(client_address.sin_addr.s_addr)) {
+            // 只拒绝该连接，继续accept其他客户端
+            utils.show_error(connfd, ip_limited_response());
+            LOG_WARN("too many connections from %s", inet_ntoa(client_address.sin_addr));
+            metrics::inc(M_IP_CONN_LIMITED);
+            continue;
         }
-        return false;
+        metrics::inc(M_ACCEPTS);
+        // 在这里初始化计时器对象
+        timer(connfd, client_address);
     }
     return true;
 }
@@ -272,6 +718,18 @@ bool WebServer::dealwithsignal(bool &timeout, bool &stop_server) {
                     stop_server = true;
                     break;
                 }
+                case SIGUSR1: {
+                    // 输出更详细的日志
+                    Log::set_level(Log::get_level() - 1);
+                    LOG_WARN("log level changed to %d", Log::get_level());
+                    break;
+                }
+                case SIGUSR2: {
+                    // 只输出更严重的日志
+                    Log::set_level(Log::get_level() + 1);
+                    LOG_WARN("log level changed to %d", Log::get_level());
+                    break;
+                }
             }
         }
     }
@@ -294,7 +752,22 @@ void WebServer::dealwithread(int sockfd) {
         }
 
         // 若监测到读事件，将该事件放入请求队列
-        m_pool->append(users + sockfd, 0);
+        users[sockfd].stage_begin();
+        bool limited = !ip_limit::get_instance()->on_request(users[sockfd].get_address()->sin_addr.s_addr);
+        if (limited || m_pool->overloaded() || !m_pool->append(users + sockfd, 0)) {
+            // 超过该IP的请求速率、过载或队列已满，主线程读取请求后直接回复429或503
+            metrics::inc(limited ? M_IP_RATE_LIMITED : M_SHED_ADMISSION);
+            if (users[sockfd].read_once()) {
+                if (limited) {
+                    users[sockfd].reject_rate_limited();
+                } else {
+                    users[sockfd].reject_overload();
+                }
+            } else {
+                deal_timer(timer, sockfd);
+            }
+            return;
+        }
 
         // 这部分作用？
         while (true) {
@@ -310,10 +783,18 @@ void WebServer::dealwithread(int sockfd) {
     } else {
         // proactor
         if (users[sockfd].read_once()) {
-            LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+            users[sockfd].stage_begin();
+            LOG_DEBUG("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
 
             // 若监测到读事件，将该事件放入请求队列
-            m_pool->append_p(users + sockfd);
+            // 超过该IP的请求速率时直接回复429，过载或队列已满时直接回复503
+            if (!ip_limit::get_instance()->on_request(users[sockfd].get_address()->sin_addr.s_addr)) {
+                metrics::inc(M_IP_RATE_LIMITED);
+                users[sockfd].reject_rate_limited();
+            } else if (m_pool->overloaded() || !m_pool->append_p(users + sockfd)) {
+                metrics::inc(M_SHED_ADMISSION);
+                users[sockfd].reject_overload();
+            }
 
             // 若有数据传输，则将定时器往后延迟3个单位
             // 对其在链表上的位置进行调整
@@ -335,7 +816,13 @@ void WebServer::dealwithwrite(int sockfd) {
             adjust_timer(timer);
         }
 
-        m_pool->append(users + sockfd, 1);
+        if (!m_pool->append(users + sockfd, 1)) {
+            // 队列已满时由主线程直接发送，响应已经生成，不丢弃
+            if (!users[sockfd].write()) {
+                deal_timer(timer, sockfd);
+            }
+            return;
+        }
 
         while (true) {
             if (1 == users[sockfd].improv) {
@@ -350,7 +837,7 @@ void WebServer::dealwithwrite(int sockfd) {
     } else {
         // proactor
         if (users[sockfd].write()) {
-            LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+            LOG_DEBUG("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
 
             if (timer) {
                 adjust_timer(timer);
@@ -375,7 +862,9 @@ void WebServer::eventLoop() {
          * 返回准备好的fd数量
          **/
         // 这里是阻塞等待
-        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        // 暂停accept期间定时检查是否已恢复，排空期间定时检查是否可以退出
+        int wait_ms = m_accept_paused ? 10 : (m_draining ? 1000 : -1);
+        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, wait_ms);
         if (number < 0 && errno != EINTR) {
             LOG_ERROR("%s", "epoll failure");
             break;
@@ -386,7 +875,12 @@ void WebServer::eventLoop() {
             int sockfd = events[i].data.fd;
 
             // 处理新到的客户连接
-            if (sockfd == m_listenfd) {
+            if (sockfd == m_handoff_fd) {
+                // 新进程请求交接监听socket
+                if (!m_draining) {
+                    deal_handoff();
+                }
+            } else if (sockfd == m_listenfd) {
                 // 当一个新用户访问时，调用dealclinetdata()为该用户初始化http_conn对象加入epoll监听，和初始化定时器对象，加入非活动连接管理
                 bool flag = dealclinetdata();  // 在这里初始化定时器对象
                 if (false == flag) {
@@ -414,12 +908,37 @@ void WebServer::eventLoop() {
                 dealwithwrite(sockfd);
             }
         }
+        check_overload();
+
         // 处理定时器为非必须事件，收到信号并不是立马处理
         // 完成读写事件后，再进行处理
         if (timeout) {
             utils.timer_handler();
-            LOG_INFO("%s", "timer tick");
+            // 同步模式下没有后台线程，空闲时由定时器按间隔刷新日志
+            if (0 == m_close_log) {
+                Log::get_instance()->flush();
+            }
+            LOG_DEBUG("%s", "timer tick");
             timeout = false;
         }
+
+        if (m_draining) {
+            if (m_listenfd >= 0) {
+                // 监听socket已由新进程持有；交接路径也已属于新进程，只关闭不删除
+                close(m_listenfd);
+                close(m_handoff_fd);
+                m_listenfd = -1;
+                m_handoff_fd = -1;
+            }
+            if (0 == http_conn::m_user_count) {
+                LOG_INFO("%s", "drained, exiting");
+                break;
+            }
+            if (time(NULL) >= m_drain_deadline) {
+                LOG_WARN("drain timeout, closing %d connections", http_conn::m_user_count.load());
+                break;
+            }
+        }
     }
+    Log::get_instance()->flush();
 }
\ No newline at end of file
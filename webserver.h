@@ -11,13 +11,22 @@
 #include <stdlib.h>
 #include <cassert>
 #include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #include "./threadpool/threadpool.h"
 #include "./http/http_conn.h"
+#include "./affinity/affinity.h"
+#include "./sockopt/sock_profile.h"
+#include "./metrics/stats_shm.h"
 
 const int MAX_FD = 65536;           //最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; //最大事件数
 const int TIMESLOT = 5;             //最小超时单位
+const int ACCEPT_BATCH = 64;        //LT模式下每次监听事件最多accept的连接数
+const int DEFER_ACCEPT_SECONDS = 5; //TCP_DEFER_ACCEPT等待首个数据包的秒数，超时后仍会交给accept
+const int DRAIN_SECONDS = 30;       //热重启后旧进程排空连接的最长时间
 
 class WebServer {
 public:
@@ -27,7 +36,11 @@ public:
 
     void init(int port, string user, string passWord, string databaseName,
               int log_write, int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
+              int sql_min_num, int thread_num, int close_log, int actor_model, int user_snapshot, int sql_mode,
+              int log_binary, int log_level, int log_split_mb, int log_gzip, int metrics_port, int slow_ms, int overload_ms,
+              int ip_conns, int ip_rate, string loop_cpus, string worker_cpus, string log_cpus,
+              string sock_opts, string handoff_path,
+              int processes, int stats, string cache_control);
 
     void thread_pool();
 
@@ -37,8 +50,29 @@ public:
 
     void trig_mode();
 
+    // 多进程模式：创建监听socket后fork工作进程，只在工作进程中返回
+    void prefork();
+
     void eventListen();
 
+    void add_listenfd();
+
+    void create_listenfd(const sock_profile &profile, string &failed);
+
+    // 热重启：新进程从旧进程接收监听socket，旧进程交出后排空连接再退出
+    bool inherit_listenfd();
+
+    void handoff_listen();
+
+    void deal_handoff();
+
+    void start_drain();
+
+    void cpu_affinity();
+
+    // 解析CPU列表，多进程模式下只取本工作进程分到的一份
+    bool resolve_cpus(const string &spec, vector<int> &cpus);
+
     void eventLoop();
 
     void timer(int connfd, struct sockaddr_in client_address);
@@ -55,13 +89,35 @@ public:
 
     void dealwithwrite(int sockfd);
 
+    void check_overload();
+
 public:
     // 基础
     int m_port;
     char *m_root;
     int m_log_write;
+    int m_log_binary;
+    int m_log_level;
+    int m_log_split_mb;
+    int m_log_gzip;
     int m_close_log;
     int m_actormodel;
+    int m_metrics_port;
+    int m_slow_ms;
+    int m_ip_conns;        // 单个IP的最大连接数，0为不限制
+    int m_ip_rate;         // 单个IP每秒的请求数，0为不限制
+    string m_loop_cpus;    // 主线程、工作线程、日志线程绑定的CPU，空为不绑定
+    string m_worker_cpus;
+    string m_log_cpus;
+    string m_sock_opts;    // socket调优选项，见sock_profile.h
+    string m_handoff_path; // 热重启交接监听socket的UNIX socket路径，空为关闭
+    int m_handoff_fd;
+    bool m_draining;       // 已交出监听socket，等待现有连接结束
+    time_t m_drain_deadline;
+    int m_processes;       // 工作进程数，0为单进程
+    int m_worker_id;       // 工作进程编号，单进程为-1
+    int m_stats;           // 是否发布共享内存统计段
+    string m_cache_control; // 静态文件按路径前缀的Cache-Control，见http_conn::set_cache_rules
 
     int m_pipefd[2];  // 套接字柄对
     int m_epollfd;
@@ -73,10 +129,15 @@ public:
     string m_passWord;     // 登陆数据库密码
     string m_databaseName; // 使用数据库名
     int m_sql_num;
+    int m_sql_min_num;
+    int m_sql_mode;        // 0: 每次从连接池借用, 1: 工作线程独占连接
+    int m_user_snapshot;   // 是否使用用户表快照
 
     // 线程池相关
     threadpool<http_conn> *m_pool;
     int m_thread_num;
+    int m_overload_ms;     // 过载控制的目标排队时间(ms)，0为关闭
+    bool m_accept_paused;  // 过载时暂停accept
 
     // epoll_event相关
     epoll_event events[MAX_EVENT_NUMBER];